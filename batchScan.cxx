@@ -0,0 +1,182 @@
+/* INCLUDES */
+
+#include "coinScanner.h"
+#include "instrumentation.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkTimeProbe.h"
+#include <itksys/SystemTools.hxx>
+#include <itksys/Directory.hxx>
+#include <itksys/Glob.hxx>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+/* Shared state of the batch workers */
+struct BatchState {
+    std::vector<std::string> files;
+    const ScanOptions* options;
+    size_t next;                        // Next file to be scanned
+    unsigned int failed;
+    itk::SimpleFastMutexLock lock;      // Protects next, failed and stdout
+};
+
+/* @FUNCTIONS    */
+
+/* Check the file extension against the formats we read */
+bool isImageFile(const std::string& path) {
+    std::string extension = itksys::SystemTools::LowerCase(itksys::SystemTools::GetFilenameLastExtension(path));
+    return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".tif" || extension == ".tiff" ||
+        extension == ".mha" || extension == ".mhd" || extension == ".nrrd";
+}
+
+/* Expand a directory, glob pattern or list file into the files to scan */
+bool collectBatchFiles(const char* source, std::vector<std::string>& files) {
+    if(itksys::SystemTools::FileIsDirectory(source)) {
+        itksys::Directory directory;
+        if(!directory.Load(source)) {
+            return false;
+        }
+        for(unsigned long i = 0; i < directory.GetNumberOfFiles(); i++) {
+            std::string file = std::string(source) + "/" + directory.GetFile(i);
+            if(isImageFile(file) && !itksys::SystemTools::FileIsDirectory(file)) {
+                files.push_back(file);
+            }
+        }
+        std::sort(files.begin(), files.end());
+    } else if(strpbrk(source, "*?[") != NULL) {
+        itksys::Glob glob;
+        if(!glob.FindFiles(source)) {
+            return false;
+        }
+        files = glob.GetFiles();
+        std::sort(files.begin(), files.end());
+    } else {
+        std::ifstream list(source);
+        if(!list) {
+            return false;
+        }
+        std::string line;
+        while(std::getline(list, line)) {
+            line = itksys::SystemTools::TrimWhitespace(line);
+            if(!line.empty() && line[0] != '#') {
+                files.push_back(line);
+            }
+        }
+    }
+    return true;
+}
+
+/* Result record of one image, as one JSON line. Names and paths are appended as they are, only
+   the numbers go through a buffer, which they can't overflow. */
+std::string formatScanRecord(const std::string& file, double seconds, const std::vector<CoinResult>& results, const char* error) {
+    std::string record = "{\"file\": \"" + jsonEscape(file) + "\", ";
+    char text[256];
+    if(error != NULL) {
+        record += "\"status\": \"error\", \"error\": \"" + jsonEscape(error) + "\"}\n";
+    } else {
+        snprintf(text, sizeof(text), "\"status\": \"ok\", \"seconds\": %.3f, \"objects\": [", seconds);
+        record += text;
+        for(size_t i = 0; i < results.size(); i++) {
+            snprintf(text, sizeof(text), "%s{\"object\": %u, \"length\": %ld, \"area\": %lu, \"roundness\": %.3f, \"type\": \"",
+                i > 0 ? ", " : "", results[i].object, results[i].length, results[i].area, results[i].roundness);
+            record += text;
+            record += jsonEscape(results[i].type);
+            snprintf(text, sizeof(text), "\", \"r\": %d, \"g\": %d, \"b\": %d}", results[i].r, results[i].g, results[i].b);
+            record += text;
+        }
+        record += "]}\n";
+    }
+    return record;
+}
+
+/* Worker thread: take the next file, scan it and stream its record */
+static ITK_THREAD_RETURN_TYPE batchWorker(void* arg) {
+    itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct*) arg;
+    BatchState* state = (BatchState*) info->UserData;
+
+    while(true) {
+        state->lock.Lock();
+        if(state->next >= state->files.size()) {
+            state->lock.Unlock();
+            break;
+        }
+        std::string file = state->files[state->next++];
+        state->lock.Unlock();
+
+        // Every pipeline object is created by this thread for this image
+        std::vector<CoinResult> results;
+        std::string error;
+        itk::TimeProbe time;
+        time.Start();
+        try {
+            scanImage(file.c_str(), *state->options, results);
+        } catch(itk::ExceptionObject& e) {
+            error = e.GetDescription();
+        } catch(std::exception& e) {
+            error = e.what();
+        }
+        time.Stop();
+
+        state->lock.Lock();
+        if(!error.empty()) {
+            state->failed++;
+        }
+        fputs(formatScanRecord(file, time.GetTotal(), results, error.empty() ? NULL : error.c_str()).c_str(), stdout);
+        fflush(stdout);
+        state->lock.Unlock();
+    }
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+int runBatch(const char* source, const ScanOptions& options, unsigned int threads) {
+    BatchState state;
+    if(!collectBatchFiles(source, state.files)) {
+        fprintf(stderr, "Could not read batch source: %s\n", source);
+        return 1;
+    }
+    state.options = &options;
+    state.next = 0;
+    state.failed = 0;
+
+    // Parallelism is across images: keep every ITK filter single threaded so the
+    // workers don't oversubscribe the cores, and skip the per-step progress lines
+    if(threads == 0) {
+        threads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+    threads = std::min<unsigned int>(threads, itk::MultiThreader::GetGlobalMaximumNumberOfThreads());
+    if(threads > state.files.size() && !state.files.empty()) {
+        threads = state.files.size();
+    }
+    // Both settings are process wide, the caller gets them back
+    itk::ThreadIdType defaultThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    int progressShown = showProgress;
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads(1);
+    showProgress = 0;
+
+    ScanOptions batchOptions = options;
+    batchOptions.outputImages = 0;
+    state.options = &batchOptions;
+
+    itk::TimeProbe time;
+    time.Start();
+    if(!state.files.empty()) {
+        itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+        threader->SetNumberOfThreads(threads);
+        threader->SetSingleMethod(batchWorker, &state);
+        threader->SingleMethodExecute();
+    }
+    time.Stop();
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads(defaultThreads);
+    showProgress = progressShown;
+
+    fprintf(stderr, "> Batch: %lu images - %u failed - %u threads - %.3fs - %.2f images/s - Peak memory: %ld KB\n",
+        (unsigned long) state.files.size(), state.failed, threads, time.GetTotal(),
+        time.GetTotal() > 0 ? state.files.size() / time.GetTotal() : 0.0, peakResidentMemory());
+
+    return state.failed > 0 ? 1 : 0;
+}
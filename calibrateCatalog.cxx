@@ -0,0 +1,175 @@
+/* INCLUDES */
+
+#include "coinPipeline.h"
+#include <itksys/SystemTools.hxx>
+#include <itksys/Directory.hxx>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Margin added around the color averages seen in the reference images */
+#define CALIBRATION_COLOR_MARGIN 20
+
+/* Bounds of the derived tolerance, which is MARGEM_ERRO for coins with a single reference */
+#define CALIBRATION_MIN_TOLERANCE 0.02
+#define CALIBRATION_MAX_TOLERANCE 0.2
+
+/* Measures of one reference coin */
+struct CoinSample {
+    long length;
+    long area;
+    int color[3];
+};
+
+/* @FUNCTIONS    */
+
+/* Sorted names of the entries of a directory, only subdirectories or only image files */
+static std::vector<std::string> listDirectory(const std::string& path, bool directories) {
+    std::vector<std::string> names;
+    itksys::Directory directory;
+    if(directory.Load(path.c_str())) {
+        for(unsigned long i = 0; i < directory.GetNumberOfFiles(); i++) {
+            std::string name = directory.GetFile(i);
+            std::string file = path + "/" + name;
+            bool isDirectory = itksys::SystemTools::FileIsDirectory(file.c_str());
+            if(name[0] != '.' && isDirectory == directories && (directories || isImageFile(file))) {
+                names.push_back(name);
+            }
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+/* Median of a list of measures */
+static long median(std::vector<long> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+/* Segment a reference image and measure its largest round object that doesn't touch the
+   image border */
+static bool measureReference(const std::string& file, const ScanOptions& options, CoinSample& sample) {
+    ReaderColorType::Pointer readerColor = readColorFromFile((char*) file.c_str());
+    ImageColorType::Pointer imageColor = readerColor->GetOutput();
+    ImageType::Pointer image = convertToGray(imageColor);
+    InvertIntensityImageFilterType::Pointer invertIntensityFilter = segmentImage(image, CLOSING_RADIUS, options);
+    std::vector<RegionStats> regions;
+    getRegionStats(invertIntensityFilter->GetOutput(), imageColor, imageColor->GetBufferedRegion().GetIndex(), regions);
+
+    ImageType::SizeType imageSize = image->GetBufferedRegion().GetSize();
+    const RegionStats* coin = NULL;
+    for(size_t i = 0; i < regions.size(); i++) {
+        const RegionStats& region = regions[i];
+        long length;
+        bool elongated;
+        classifyBox(region.width, region.height, &length, &elongated);
+        bool inside = region.x > 0 && region.y > 0 && region.x + region.width < imageSize[0] && region.y + region.height < imageSize[1];
+        if(!elongated && inside && (coin == NULL || region.pixels > coin->pixels)) {
+            coin = &region;
+        }
+    }
+    if(coin == NULL) {
+        return false;
+    }
+
+    bool elongated;
+    classifyBox(coin->width, coin->height, &sample.length, &elongated);
+    sample.area = coin->pixels;
+    for(int c = 0; c < 3; c++) {
+        sample.color[c] = (int) (coin->mean[c] + 0.5);
+    }
+    return true;
+}
+
+/* Derive the catalog entry of a coin from its reference measures */
+static CoinSpec deriveCoinSpec(const std::string& name, const std::vector<CoinSample>& samples) {
+    std::vector<long> lengths;
+    std::vector<long> areas;
+    for(size_t i = 0; i < samples.size(); i++) {
+        lengths.push_back(samples[i].length);
+        areas.push_back(samples[i].area);
+    }
+
+    CoinSpec spec;
+    spec.name = name;
+    spec.length = median(lengths);
+    spec.area = median(areas);
+    spec.tolerance = MARGEM_ERRO;
+    if(samples.size() > 1) {
+        // Cover the spread of the references with some room to spare
+        double spread = 0;
+        for(size_t i = 0; i < samples.size(); i++) {
+            spread = std::max(spread, fabs((double) (samples[i].length - spec.length)) / spec.length);
+        }
+        spec.tolerance = std::min(std::max(1.5 * spread, CALIBRATION_MIN_TOLERANCE), CALIBRATION_MAX_TOLERANCE);
+    }
+    for(int c = 0; c < 3; c++) {
+        spec.colorMin[c] = 255;
+        spec.colorMax[c] = 0;
+        for(size_t i = 0; i < samples.size(); i++) {
+            spec.colorMin[c] = std::min(spec.colorMin[c], samples[i].color[c]);
+            spec.colorMax[c] = std::max(spec.colorMax[c], samples[i].color[c]);
+        }
+        spec.colorMin[c] = std::max(spec.colorMin[c] - CALIBRATION_COLOR_MARGIN, 0);
+        spec.colorMax[c] = std::min(spec.colorMax[c] + CALIBRATION_COLOR_MARGIN, 255);
+    }
+    return spec;
+}
+
+int runCalibration(const char* directory, const ScanOptions& options) {
+    if(!itksys::SystemTools::FileIsDirectory(directory)) {
+        fprintf(stderr, "Could not read calibration directory: %s\n", directory);
+        return 1;
+    }
+    showProgress = 0;
+
+    // One subdirectory per coin, named after it, with its reference images
+    std::vector<CoinSpec> entries;
+    std::vector<std::string> coins = listDirectory(directory, true);
+    for(size_t i = 0; i < coins.size(); i++) {
+        std::string coinDirectory = std::string(directory) + "/" + coins[i];
+        std::vector<std::string> files = listDirectory(coinDirectory, false);
+        std::vector<CoinSample> samples;
+        for(size_t j = 0; j < files.size(); j++) {
+            std::string file = coinDirectory + "/" + files[j];
+            CoinSample sample;
+            try {
+                if(measureReference(file, options, sample)) {
+                    samples.push_back(sample);
+                } else {
+                    fprintf(stderr, "> %s: no coin found, skipped\n", file.c_str());
+                }
+            } catch(itk::ExceptionObject& e) {
+                fprintf(stderr, "> %s: %s, skipped\n", file.c_str(), e.GetDescription());
+            }
+        }
+        if(samples.empty()) {
+            fprintf(stderr, "> %s: no references, skipped\n", coins[i].c_str());
+            continue;
+        }
+        entries.push_back(deriveCoinSpec(coins[i], samples));
+        fprintf(stderr, "> %s: %lu references, length %ld\n", coins[i].c_str(), (unsigned long) samples.size(), entries.back().length);
+    }
+    if(entries.empty()) {
+        fprintf(stderr, "No coin could be calibrated from %s\n", directory);
+        return 1;
+    }
+
+    // Overlapping lengths are resolved by closeness, then by color, but are worth knowing about
+    for(size_t i = 0; i < entries.size(); i++) {
+        for(size_t j = i + 1; j < entries.size(); j++) {
+            double reach = entries[i].length * entries[i].tolerance + entries[j].length * entries[j].tolerance;
+            if(labs(entries[i].length - entries[j].length) < reach) {
+                fprintf(stderr, "> Warning: the lengths of %s and %s overlap\n", entries[i].name.c_str(), entries[j].name.c_str());
+            }
+        }
+    }
+
+    CoinCatalog catalog(&entries[0], entries.size());
+    catalog.Write(stdout);
+    return 0;
+}
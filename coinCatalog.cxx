@@ -0,0 +1,177 @@
+/* INCLUDES */
+
+#include "coinCatalog.h"
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <stdlib.h>
+
+/* Longest coin length accepted in a catalog file, bounds the size of the table */
+#define MAX_COIN_LENGTH 100000
+
+/* Entry matching a table slot */
+struct SlotMatch {
+    long length;
+    long diff;
+    unsigned short entry;
+
+    bool operator<(const SlotMatch& other) const {
+        if(length != other.length) {
+            return length < other.length;
+        }
+        if(diff != other.diff) {
+            return diff < other.diff;
+        }
+        return entry < other.entry;
+    }
+};
+
+/* @FUNCTIONS    */
+
+/* Distance of a measure to the expected value, 0 if it is outside the error margin. Exact
+   matches count as 1, like off by one ones. */
+static long matchDistance(long measure, long expected, double tolerance) {
+    if(measure < (expected + expected * tolerance) && measure > (expected - expected * tolerance)) {
+        long diff = measure > expected ? measure - expected : expected - measure;
+        return diff == 0 ? 1 : diff;
+    }
+    return 0;
+}
+
+CoinCatalog::CoinCatalog(const CoinSpec* entries, unsigned int count) {
+    SetEntries(std::vector<CoinSpec>(entries, entries + count));
+}
+
+void CoinCatalog::SetEntries(const std::vector<CoinSpec>& entries) {
+    m_Entries = entries;
+    Compile();
+}
+
+/* Build the length table */
+void CoinCatalog::Compile() {
+    std::vector<SlotMatch> matches;
+    for(size_t i = 0; i < m_Entries.size(); i++) {
+        const CoinSpec& spec = m_Entries[i];
+        if(spec.length <= 0) {
+            continue;
+        }
+        long first = (long) floor(spec.length - spec.length * spec.tolerance);
+        long last = (long) ceil(spec.length + spec.length * spec.tolerance);
+        for(long length = std::max(first, 1L); length <= last; length++) {
+            long diff = matchDistance(length, spec.length, spec.tolerance);
+            if(diff > 0) {
+                SlotMatch match = {length, diff, (unsigned short) i};
+                matches.push_back(match);
+            }
+        }
+    }
+    std::sort(matches.begin(), matches.end());
+
+    m_Candidates.clear();
+    m_Offsets.clear();
+    if(matches.empty()) {
+        m_MinLength = 1;
+        m_Offsets.push_back(0);
+        return;
+    }
+    m_MinLength = matches.front().length;
+    long slots = matches.back().length - m_MinLength + 1;
+    m_Offsets.reserve(slots + 1);
+    size_t next = 0;
+    for(long slot = 0; slot < slots; slot++) {
+        m_Offsets.push_back(m_Candidates.size());
+        while(next < matches.size() && matches[next].length == m_MinLength + slot) {
+            m_Candidates.push_back(matches[next].entry);
+            next++;
+        }
+    }
+    m_Offsets.push_back(m_Candidates.size());
+}
+
+unsigned int CoinCatalog::FindByLength(long length, const unsigned short** candidates) const {
+    long slot = length - m_MinLength;
+    if(slot < 0 || slot + 1 >= (long) m_Offsets.size()) {
+        return 0;
+    }
+    *candidates = &m_Candidates[0] + m_Offsets[slot];
+    return m_Offsets[slot + 1] - m_Offsets[slot];
+}
+
+int CoinCatalog::FindByArea(long area) const {
+    int closest = -1;
+    long closestDiff = 0;
+    for(size_t i = 0; i < m_Entries.size(); i++) {
+        long diff = matchDistance(area, m_Entries[i].area, m_Entries[i].tolerance);
+        if(diff > 0 && (closest < 0 || diff < closestDiff)) {
+            closest = i;
+            closestDiff = diff;
+        }
+    }
+    return closest;
+}
+
+/* Catalog file: one coin per line, '#' starts a comment.
+       length  area  tolerance  red  green  blue  name
+   length and area are in pixels (0 = not used), colors are MIN-MAX ranges of the color
+   averages and the name is the rest of the line. */
+bool CoinCatalog::Load(const char* path, std::string& error) {
+    std::ifstream file(path);
+    if(!file) {
+        error = std::string("could not open ") + path;
+        return false;
+    }
+
+    std::vector<CoinSpec> entries;
+    std::string line;
+    for(unsigned int number = 1; std::getline(file, line); number++) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if(start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+
+        CoinSpec spec;
+        int nameStart = -1;
+        sscanf(line.c_str(), "%ld %ld %lf %d-%d %d-%d %d-%d %n", &spec.length, &spec.area, &spec.tolerance,
+            &spec.colorMin[0], &spec.colorMax[0], &spec.colorMin[1], &spec.colorMax[1], &spec.colorMin[2], &spec.colorMax[2], &nameStart);
+        size_t nameEnd = line.find_last_not_of(" \t\r");
+        bool valid = nameStart > 0 && (size_t) nameStart <= nameEnd;
+        valid = valid && spec.length >= 0 && spec.length <= MAX_COIN_LENGTH && spec.area >= 0;
+        valid = valid && spec.tolerance > 0 && spec.tolerance < 1;
+        for(int c = 0; valid && c < 3; c++) {
+            valid = spec.colorMin[c] >= 0 && spec.colorMin[c] <= spec.colorMax[c] && spec.colorMax[c] <= 255;
+        }
+        if(!valid) {
+            char lineNumber[16];
+            sprintf(lineNumber, "%u", number);
+            error = std::string(path) + ":" + lineNumber + ": invalid coin entry";
+            return false;
+        }
+        spec.name = line.substr(nameStart, nameEnd - nameStart + 1);
+        entries.push_back(spec);
+    }
+
+    if(entries.empty() || entries.size() > 65535) {
+        error = std::string(path) + ": the catalog must have between 1 and 65535 coins";
+        return false;
+    }
+    SetEntries(entries);
+    return true;
+}
+
+void CoinCatalog::Write(FILE* file) const {
+    fprintf(file, "# length     area  tolerance  red      green    blue     name\n");
+    for(size_t i = 0; i < m_Entries.size(); i++) {
+        const CoinSpec& spec = m_Entries[i];
+        char colors[3][16];
+        for(int c = 0; c < 3; c++) {
+            sprintf(colors[c], "%d-%d", spec.colorMin[c], spec.colorMax[c]);
+        }
+        fprintf(file, "%8ld %8ld  %9.4f  %-8s %-8s %-8s %s\n", spec.length, spec.area, spec.tolerance, colors[0], colors[1], colors[2], spec.name.c_str());
+    }
+}
+
+bool acceptsColor(const CoinSpec& spec, int r, int g, int b) {
+    return r >= spec.colorMin[0] && r <= spec.colorMax[0] &&
+        g >= spec.colorMin[1] && g <= spec.colorMax[1] &&
+        b >= spec.colorMin[2] && b <= spec.colorMax[2];
+}
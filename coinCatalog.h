@@ -0,0 +1,63 @@
+#ifndef COIN_CATALOG_H
+#define COIN_CATALOG_H
+
+/* INCLUDES */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/* Catalog entry of one coin */
+struct CoinSpec {
+    std::string name;
+    long length;            // Expected largest bounding box side, in pixels (0 = not matched by length)
+    long area;              // Expected pixel amount (0 = not matched by area)
+    double tolerance;       // Relative error margin of length and area
+    int colorMin[3];        // Accepted color averages (R, G, B)
+    int colorMax[3];
+};
+
+/* Coin catalog. Entries are compiled into a table indexed by measured length, holding for
+   each length the matching entries closest first, so classifying an object costs the same
+   whatever the number of coins. A length matches an entry when it is strictly inside
+   length * (1 -+ tolerance); ties go to the entry listed first. */
+class CoinCatalog {
+public:
+    CoinCatalog(const CoinSpec* entries, unsigned int count);
+
+    /* Replace the entries by the ones of a catalog file. On failure the catalog is left
+       unchanged and 'error' describes the problem. */
+    bool Load(const char* path, std::string& error);
+
+    /* Write the entries in the catalog file format */
+    void Write(FILE* file) const;
+
+    void SetEntries(const std::vector<CoinSpec>& entries);
+    const std::vector<CoinSpec>& GetEntries() const { return m_Entries; }
+
+    /* Entries matching a length, closest first. Returns their number and points 'candidates'
+       at their indexes. */
+    unsigned int FindByLength(long length, const unsigned short** candidates) const;
+
+    /* Closest entry matching a pixel amount, or -1 */
+    int FindByArea(long area) const;
+
+    /* Shortest and longest lengths matching any entry (empty range if none) */
+    long GetMinLength() const { return m_MinLength; }
+    long GetMaxLength() const { return m_MinLength + (long) m_Offsets.size() - 2; }
+
+private:
+    void Compile();
+
+    std::vector<CoinSpec> m_Entries;
+    long m_MinLength;                           // Length of the first table slot
+    std::vector<unsigned int> m_Offsets;        // Candidates of slot i are [m_Offsets[i], m_Offsets[i+1])
+    std::vector<unsigned short> m_Candidates;
+};
+
+/* @FUNCTIONS    */
+
+/* True if the color averages are inside the accepted range of the entry */
+bool acceptsColor(const CoinSpec& spec, int r, int g, int b);
+
+#endif
@@ -0,0 +1,894 @@
+/* INCLUDES */
+
+#include "coinPipeline.h"
+#include "fastClosing.h"
+#include "regionStats.h"
+#include "runLabeler.h"
+#include "thresholdMask.h"
+#include "instrumentation.h"
+#include "itkMultiThreader.h"
+#include "outputWriter.h"
+#include "resultCache.h"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+/* Built in catalog, used when no catalog file is given */
+static const CoinSpec defaultCoins[] = {
+    {"1 REAL",            MOEDA_1_REAL_LENGTH,        MOEDA_1_REAL_PIXEL,        MARGEM_ERRO, {0, 0, 0}, {255, 255, 255}},
+    {"50 CENTAVOS",       MOEDA_50_CENT_LENGTH,       MOEDA_50_CENT_PIXEL,       MARGEM_ERRO, {0, 0, 0}, {255, 255, 255}},
+    {"25 CENTAVOS",       MOEDA_25_CENT_LENGTH,       MOEDA_25_CENT_PIXEL,       MARGEM_ERRO, {0, 0, 0}, {255, 255, 255}},
+    {"10 CENTAVOS",       MOEDA_10_CENT_LENGTH,       MOEDA_10_CENT_PIXEL,       MARGEM_ERRO, {0, 0, 0}, {255, 255, 255}},
+    {"10 CENTAVOS GOLD",  MOEDA_10_CENT_GOLD_LENGTH,  MOEDA_10_CENT_GOLD_PIXEL,  MARGEM_ERRO, {0, 0, 0}, {255, 255, 255}},
+    {"5 CENTAVOS",        MOEDA_5_CENT_LENGTH,        MOEDA_5_CENT_PIXEL,        MARGEM_ERRO, {0, 0, 0}, {255, 255, 255}},
+    {"5 CENTAVOS BRONZE", MOEDA_5_CENT_BRONZE_LENGTH, MOEDA_5_CENT_BRONZE_PIXEL, MARGEM_ERRO, {0, 0, 0}, {255, 255, 255}}
+};
+
+CoinCatalog coinCatalog(defaultCoins, sizeof(defaultCoins) / sizeof(defaultCoins[0]));
+
+/* @FUNCTIONS    */
+
+int showProgress = 1;
+
+/* Set on the worker threads of a parallel scan */
+static __thread bool scanWorker = false;
+
+void setScanWorker(bool worker) {
+    scanWorker = worker;
+}
+
+/* Print a progress line, unless progress is disabled (batch mode) or this is a scan worker */
+void progress(const char* format, ...) {
+    if(!showProgress || scanWorker) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/* Create reader from file */
+ReaderType::Pointer readFromFile(char* path) {
+    StageProbe stage("read", (std::string("Reading file: ") + path).c_str());
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(path);
+    reader->Update();
+    stage.Done(reader->GetOutput()->GetLargestPossibleRegion().GetNumberOfPixels());
+    
+    return reader;
+}
+
+/* Create reader from file */
+ReaderColorType::Pointer readColorFromFile(char* path) {
+    StageProbe stage("read", (std::string("Reading file: ") + path).c_str());
+    ReaderColorType::Pointer reader = ReaderColorType::New();
+    reader->SetFileName(path);
+    reader->Update();
+    stage.Done(reader->GetOutput()->GetLargestPossibleRegion().GetNumberOfPixels());
+    
+    return reader;
+}
+
+/* True if ITK's gray read of a file with this number of components uses an alpha channel */
+bool hasAlphaChannel(unsigned int components) {
+    return components == 2 || components == 4;
+}
+
+/* Decode a file into its colors, and its gray image if alpha changes it */
+ImageColorType::Pointer readScanImage(const char* path, ImageType::Pointer& gray) {
+    StageProbe stage("read", (std::string("Reading file: ") + path).c_str());
+    gray = NULL;
+    ReaderColorType::Pointer reader = ReaderColorType::New();
+    reader->SetFileName(path);
+    reader->UpdateOutputInformation();
+    unsigned int components = reader->GetImageIO()->GetNumberOfComponents();
+    ImageColorType::Pointer color;
+    if(components == 4) {
+        // Alpha is dropped from the colors and applied to the gray levels, with ITK's formula
+        ReaderRGBAType::Pointer readerRGBA = ReaderRGBAType::New();
+        readerRGBA->SetFileName(path);
+        readerRGBA->Update();
+        ImageRGBAType::Pointer rgba = readerRGBA->GetOutput();
+        color = ImageColorType::New();
+        color->CopyInformation(rgba);
+        color->SetRegions(rgba->GetLargestPossibleRegion());
+        color->Allocate();
+        gray = ImageType::New();
+        gray->CopyInformation(rgba);
+        gray->SetRegions(rgba->GetLargestPossibleRegion());
+        gray->Allocate();
+        const RGBAPixelType* in = rgba->GetBufferPointer();
+        RGBPixelType* outColor = color->GetBufferPointer();
+        ImageType::PixelType* outGray = gray->GetBufferPointer();
+        size_t pixels = rgba->GetLargestPossibleRegion().GetNumberOfPixels();
+        for(size_t i = 0; i < pixels; i++) {
+            outColor[i][0] = in[i][0];
+            outColor[i][1] = in[i][1];
+            outColor[i][2] = in[i][2];
+            double level = (2125.0 * in[i][0] + 7154.0 * in[i][1] + 721.0 * in[i][2]) / 10000.0;
+            outGray[i] = (ImageType::PixelType) (level * in[i][3] / 255.0);
+        }
+    } else {
+        reader->Update();
+        color = reader->GetOutput();
+        color->DisconnectPipeline();
+        if(hasAlphaChannel(components)) {
+            ReaderType::Pointer readerGray = ReaderType::New();
+            readerGray->SetFileName(path);
+            readerGray->Update();
+            gray = readerGray->GetOutput();
+            gray->DisconnectPipeline();
+        }
+    }
+    stage.Done(color->GetLargestPossibleRegion().GetNumberOfPixels());
+
+    return color;
+}
+
+/* Create grayscale image from a decoded color image. Uses the same luminance weights and
+   truncation as ITK's RGB to scalar conversion, so the result matches reading the file
+   directly as ImageType for files without alpha. */
+ImageType::Pointer convertToGray(ImageColorType::Pointer src) {
+    ImageType::Pointer gray = ImageType::New();
+    convertToGray(src, gray);
+
+    return gray;
+}
+
+/* Fill a gray image from a color image, reusing its buffer if it has the same size */
+void convertToGray(ImageColorType::Pointer src, ImageType::Pointer gray) {
+    if(gray->GetBufferPointer() == NULL || gray->GetBufferedRegion() != src->GetLargestPossibleRegion()) {
+        gray->CopyInformation(src);
+        gray->SetRegions(src->GetLargestPossibleRegion());
+        gray->Allocate();
+    }
+    ImageType::SizeType size = src->GetLargestPossibleRegion().GetSize();
+    convertToGray(reinterpret_cast<const unsigned char*>(src->GetBufferPointer()), size[0] * sizeof(RGBPixelType), gray);
+}
+
+/* Fill an allocated gray image from interleaved RGB rows */
+void convertToGray(const unsigned char* rgb, long rgbStride, ImageType::Pointer gray) {
+    StageProbe stage("gray", "Converting to grayscale");
+    ImageType::SizeType size = gray->GetBufferedRegion().GetSize();
+    ImageType::PixelType* out = gray->GetBufferPointer();
+    for(unsigned int y = 0; y < size[1]; y++) {
+        const unsigned char* in = rgb + y * rgbStride;
+        for(unsigned int x = 0; x < size[0]; x++, in += 3) {
+            // Integer form of (2125*R + 7154*G + 721*B) / 10000.0, exact for 8 bit components
+            *out++ = (ImageType::PixelType) ((2125 * (unsigned int) in[0] + 7154 * (unsigned int) in[1] + 721 * (unsigned int) in[2]) / 10000);
+        }
+    }
+    gray->Modified();
+    stage.Done(gray->GetBufferedRegion().GetNumberOfPixels());
+}
+
+/* Binary threshold filter */
+BinaryThresholdImageFilterType::Pointer applyThresholdFilter(ImageType::Pointer src, int lowerThreshold, int upperThreshold, int insideValue, int outsideValue) {
+    StageProbe stage("threshold", "Applying Threshold filter");
+    BinaryThresholdImageFilterType::Pointer thresholdFilter  = BinaryThresholdImageFilterType::New();
+    thresholdFilter->SetInput(src);
+    thresholdFilter->SetLowerThreshold(lowerThreshold);
+    thresholdFilter->SetUpperThreshold(upperThreshold);
+    thresholdFilter->SetInsideValue(insideValue);
+    thresholdFilter->SetOutsideValue(outsideValue);
+    thresholdFilter->Update();
+    stage.Done(src->GetLargestPossibleRegion().GetNumberOfPixels());
+    
+    return thresholdFilter;
+}
+
+/* Binary threshold of gray rows */
+ImageType::Pointer applyThreshold(const unsigned char* gray, long grayStride, const ImageType::SizeType& size, int lowerThreshold, int upperThreshold, int insideValue, int outsideValue) {
+    StageProbe stage("threshold", "Applying Threshold on gray rows");
+    ImageType::Pointer mask = ImageType::New();
+    mask->SetRegions(size);
+    mask->Allocate();
+    ImageType::PixelType* out = mask->GetBufferPointer();
+    for(unsigned long y = 0; y < size[1]; y++) {
+        const unsigned char* in = gray + y * grayStride;
+        for(unsigned long x = 0; x < size[0]; x++) {
+            *out++ = in[x] >= lowerThreshold && in[x] <= upperThreshold ? insideValue : outsideValue;
+        }
+    }
+    stage.Done(mask->GetBufferedRegion().GetNumberOfPixels());
+
+    return mask;
+}
+
+/* Gray conversion and binary threshold in one pass over a color image */
+ImageType::Pointer applyColorThreshold(ImageColorType::Pointer src, int lowerThreshold, int upperThreshold, int insideValue, int outsideValue) {
+    ImageType::SizeType size = src->GetLargestPossibleRegion().GetSize();
+    ImageType::Pointer mask = applyColorThreshold(reinterpret_cast<const unsigned char*>(src->GetBufferPointer()), size[0] * sizeof(RGBPixelType), size, lowerThreshold, upperThreshold, insideValue, outsideValue);
+    mask->CopyInformation(src);
+    return mask;
+}
+
+/* Gray conversion and binary threshold in one pass over interleaved RGB rows */
+ImageType::Pointer applyColorThreshold(const unsigned char* rgb, long rgbStride, const ImageType::SizeType& size, int lowerThreshold, int upperThreshold, int insideValue, int outsideValue) {
+    StageProbe stage("color threshold", "Applying Threshold on colors");
+    ImageType::Pointer mask = ImageType::New();
+    mask->SetRegions(size);
+    mask->Allocate();
+    thresholdMask(rgb, rgbStride, size[0], size[1], lowerThreshold, upperThreshold, insideValue, outsideValue, mask->GetBufferPointer());
+    stage.Done(mask->GetBufferedRegion().GetNumberOfPixels());
+
+    return mask;
+}
+
+/* Binary erode filter */
+BinaryErodeImageFilterType::Pointer applyErodeFilter(ImageType::Pointer src, int radius) {
+    StageProbe stage("erode", "Applying Erode filter");
+    // Create structure
+    StructuringElementType structuringElement;
+    structuringElement.SetRadius(radius);
+    structuringElement.CreateStructuringElement();
+    // Run filter    
+    BinaryErodeImageFilterType::Pointer closingFilter  = BinaryErodeImageFilterType::New();
+    closingFilter->SetInput(src);
+    closingFilter->SetKernel(structuringElement);
+    if(scanWorker) {
+        closingFilter->SetNumberOfThreads(1);
+    }
+    closingFilter->Update();
+    stage.Done(src->GetLargestPossibleRegion().GetNumberOfPixels());
+    
+    return closingFilter;
+}
+
+/* Binary morphological filter */
+BinaryMorphologicalClosingImageFilterType::Pointer applyMorphologicalClosingFilter(ImageType::Pointer src, int radius) {
+    StageProbe stage("closing itk", "Applying MorphologicalClosing filter");
+    // Create structure
+    StructuringElementType structuringElement;
+    structuringElement.SetRadius(radius);
+    structuringElement.CreateStructuringElement();
+    // Run filter    
+    BinaryMorphologicalClosingImageFilterType::Pointer closingFilter  = BinaryMorphologicalClosingImageFilterType::New();
+    closingFilter->SetInput(src);
+    closingFilter->SetKernel(structuringElement);
+    if(scanWorker) {
+        closingFilter->SetNumberOfThreads(1);
+    }
+    closingFilter->Update();
+    stage.Done(src->GetLargestPossibleRegion().GetNumberOfPixels());
+    
+    return closingFilter;
+}
+
+/* Binary morphological closing using the radius independent cross closing */
+ImageType::Pointer applyFastClosingFilter(ImageType::Pointer src, int radius) {
+    src->Update();
+    StageProbe stage("closing fast", "Applying FastClosing filter");
+    ImageType::Pointer closed = ImageType::New();
+    closed->CopyInformation(src);
+    closed->SetRegions(src->GetLargestPossibleRegion());
+    closed->Allocate();
+
+    ImageType::SizeType size = src->GetLargestPossibleRegion().GetSize();
+    fastBinaryClosing(src->GetBufferPointer(), closed->GetBufferPointer(), size[0], size[1], radius, itk::NumericTraits<ImageType::PixelType>::max());
+    stage.Done(src->GetLargestPossibleRegion().GetNumberOfPixels());
+
+    return closed;
+}
+
+/* Run the selected closing engine. CLOSING_COMPARE runs both on the same input, reports their
+   times and the number of different pixels, and continues with the fast result. */
+ImageType::Pointer applyClosing(ImageType::Pointer src, int radius, int engine) {
+    if(engine == CLOSING_ITK) {
+        return applyMorphologicalClosingFilter(src, radius)->GetOutput();
+    }
+    if(engine == CLOSING_FAST) {
+        return applyFastClosingFilter(src, radius);
+    }
+
+    itk::TimeProbe itkTime;
+    itk::TimeProbe fastTime;
+    src->Update();
+    itkTime.Start();
+    ImageType::Pointer itkClosed = applyMorphologicalClosingFilter(src, radius)->GetOutput();
+    itkTime.Stop();
+    fastTime.Start();
+    ImageType::Pointer fastClosed = applyFastClosingFilter(src, radius);
+    fastTime.Stop();
+
+    const ImageType::PixelType* a = itkClosed->GetBufferPointer();
+    const ImageType::PixelType* b = fastClosed->GetBufferPointer();
+    size_t pixels = src->GetLargestPossibleRegion().GetNumberOfPixels();
+    size_t different = 0;
+    for(size_t i = 0; i < pixels; i++) {
+        if(a[i] != b[i]) {
+            different++;
+        }
+    }
+    progress("> Closing comparison: ITK: %.3fs - Fast: %.3fs - Different pixels: %lu\n", itkTime.GetTotal(), fastTime.GetTotal(), (unsigned long) different);
+
+    return fastClosed;
+}
+
+/* Invert image */
+InvertIntensityImageFilterType::Pointer invertImage(ImageType::Pointer src, int maximum) {
+    StageProbe stage("invert", "Applying Invert filter");
+    InvertIntensityImageFilterType::Pointer invertIntensityFilter = InvertIntensityImageFilterType::New();
+    invertIntensityFilter->SetInput(src);
+    invertIntensityFilter->SetMaximum(maximum);
+    invertIntensityFilter->Update();
+    stage.Done(src->GetLargestPossibleRegion().GetNumberOfPixels());
+    
+    return invertIntensityFilter;
+}
+
+/* Create LabelMap from image */
+BinaryImageToLabelMapFilterType::Pointer getLabelMap(ImageType::Pointer src) {
+    StageProbe stage("label map", "Creating LabelMap");
+    BinaryImageToLabelMapFilterType::Pointer binaryImageToLabelMapFilter = BinaryImageToLabelMapFilterType::New();
+    binaryImageToLabelMapFilter->SetInput(src);
+    binaryImageToLabelMapFilter->Update();
+    stage.Done(src->GetLargestPossibleRegion().GetNumberOfPixels(), binaryImageToLabelMapFilter->GetOutput()->GetNumberOfLabelObjects());
+    
+    return binaryImageToLabelMapFilter;
+}
+
+/* Create ShapeLabelMap from image */
+BinaryImageToShapeLabelMapFilterType::Pointer getShapeLabelMap(ImageType::Pointer src) {
+    StageProbe stage("shape label map", "Creating ShapeLabelMap");
+    BinaryImageToShapeLabelMapFilterType::Pointer binaryImageToShapeLabelMapFilter = BinaryImageToShapeLabelMapFilterType::New();
+    binaryImageToShapeLabelMapFilter->SetInput(src);
+    binaryImageToShapeLabelMapFilter->Update();
+    stage.Done(src->GetLargestPossibleRegion().GetNumberOfPixels(), binaryImageToShapeLabelMapFilter->GetOutput()->GetNumberOfLabelObjects());
+    
+    return binaryImageToShapeLabelMapFilter;
+}
+
+/* Label the objects of a binary image and measure them in one pass */
+void getRegionStats(ImageType::Pointer src, ImageColorType::Pointer imageColor, const ImageType::IndexType& colorIndex, std::vector<RegionStats>& regions, int foreground) {
+    StageProbe stage("region stats", "Measuring objects");
+    ImageType::SizeType size = src->GetBufferedRegion().GetSize();
+    const unsigned char* rgb = NULL;
+    long rgbStride = 0;
+    if(imageColor.IsNotNull()) {
+        rgb = reinterpret_cast<const unsigned char*>(imageColor->GetBufferPointer() + imageColor->ComputeOffset(colorIndex));
+        rgbStride = imageColor->GetBufferedRegion().GetSize()[0] * sizeof(RGBPixelType);
+    }
+    labelRegionStats(src->GetBufferPointer(), size[0], size[1], foreground, rgb, rgbStride, regions);
+    stage.Done(src->GetBufferedRegion().GetNumberOfPixels(), regions.size());
+}
+
+/* Bands of a run labeling, split between the threads */
+struct BandJob {
+    RunLabeler* labeler;
+    bool measure;               // Measure the selected objects instead of labeling
+    const unsigned char* rgb;
+    long rgbStride;
+};
+
+/* Labeling thread: label or measure every band of this thread */
+static ITK_THREAD_RETURN_TYPE bandWorker(void* arg) {
+    itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct*) arg;
+    BandJob* job = (BandJob*) info->UserData;
+
+    for(unsigned int band = info->ThreadID; band < job->labeler->GetNumberOfBands(); band += info->NumberOfThreads) {
+        if(job->measure) {
+            job->labeler->MeasureBand(band, job->rgb, job->rgbStride);
+        } else {
+            job->labeler->LabelBand(band);
+        }
+    }
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+/* Run a band job, on this thread if there is a single band */
+static void runBands(BandJob& job) {
+    if(job.labeler->GetNumberOfBands() == 1) {
+        itk::MultiThreader::ThreadInfoStruct info;
+        info.ThreadID = 0;
+        info.NumberOfThreads = 1;
+        info.UserData = &job;
+        bandWorker(&info);
+        return;
+    }
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads(job.labeler->GetNumberOfBands());
+    threader->SetSingleMethod(bandWorker, &job);
+    threader->SingleMethodExecute();
+}
+
+/* Label with the run labeler and measure only the objects that may be coins */
+void getCoinRegions(ImageType::Pointer src, ImageColorType::Pointer imageColor, const ImageType::IndexType& colorIndex, int foreground, std::vector<RegionStats>& regions, std::vector<unsigned int>& numbers) {
+    StageProbe stage("region stats", "Measuring objects");
+    ImageType::SizeType size = src->GetBufferedRegion().GetSize();
+    // Workers of a batch, server or tiled scan already use every core, they label in one band
+    unsigned int bands = scanWorker ? 1 : itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    RunLabeler labeler(src->GetBufferPointer(), size[0], size[1], foreground, bands);
+
+    BandJob job;
+    job.labeler = &labeler;
+    job.measure = false;
+    job.rgb = NULL;
+    job.rgbStride = 0;
+    runBands(job);
+    labeler.Merge();
+
+    // Most objects are noise, only the ones passing the size and aspect gates are measured
+    const std::vector<RegionAccumulator>& objects = labeler.GetObjects();
+    numbers.clear();
+    for(size_t i = 0; i < objects.size(); i++) {
+        if(SHOW_ALL_OUTPUT || isCoinCandidate(objects[i].maxX - objects[i].minX + 1, objects[i].maxY - objects[i].minY + 1)) {
+            labeler.Select(i);
+            numbers.push_back(i + 1);
+        }
+    }
+
+    if(imageColor.IsNotNull()) {
+        job.rgb = reinterpret_cast<const unsigned char*>(imageColor->GetBufferPointer() + imageColor->ComputeOffset(colorIndex));
+        job.rgbStride = imageColor->GetBufferedRegion().GetSize()[0] * sizeof(RGBPixelType);
+    }
+    job.measure = true;
+    runBands(job);
+    labeler.FinishMeasures();
+
+    regions.clear();
+    for(size_t i = 0; i < numbers.size(); i++) {
+        regions.push_back(labeler.GetStats(numbers[i] - 1));
+    }
+    stage.Done(src->GetBufferedRegion().GetNumberOfPixels(), objects.size());
+}
+
+/* Closest coin matching a given pixel amount */
+const char* findCoinTypeSize(long int size) {
+    int entry = coinCatalog.FindByArea(size);
+    return entry < 0 ? NULL : coinCatalog.GetEntries()[entry].name.c_str();
+}
+
+/* Closest coin matching a given length */
+const char* findCoinTypeLength(long int length) {
+    const unsigned short* candidates;
+    if(coinCatalog.FindByLength(length, &candidates) == 0) {
+        return NULL;
+    }
+    return coinCatalog.GetEntries()[candidates[0]].name.c_str();
+}
+
+/* Classify an object by the largest side of its bounding box */
+const char* classifyBox(unsigned int width, unsigned int height, long* length, bool* elongated) {
+    long max_size = width > height ? width : height;
+    double diff;
+    if(width > height) {
+        diff = (double) height / (double) width;
+    } else {
+        diff = (double) width / (double) height;
+    }
+    *length = max_size;
+    *elongated = diff < 0.8;
+    return findCoinTypeLength(max_size);
+}
+
+/* True if an object with this bounding box may be a coin */
+bool isCoinCandidate(unsigned int width, unsigned int height) {
+    long length;
+    bool elongated;
+    return classifyBox(width, height, &length, &elongated) != NULL && !elongated;
+}
+
+/* Classify a measured object, in image coordinates. The closest coin whose length and color
+   ranges accept it is appended to results, other objects are ignored. */
+void classifyRegion(const RegionStats& region, unsigned int number, std::vector<CoinResult>& results) {
+    // Check if the object size matches any coin
+    long max_size;
+    bool elongated;
+    classifyBox(region.width, region.height, &max_size, &elongated);
+    if(elongated) {
+        return;
+    }
+    const unsigned short* candidates;
+    unsigned int count = coinCatalog.FindByLength(max_size, &candidates);
+
+    // Take the closest coin whose color range accepts the object
+    CoinResult result;
+    result.type = NULL;
+    if(count > 0) {
+        result.object = number;
+        result.length = max_size;
+        result.x = region.x;
+        result.y = region.y;
+        result.width = region.width;
+        result.height = region.height;
+        result.area = region.pixels;
+        result.roundness = region.roundness;
+        result.r = (int) (region.mean[0] + 0.5);
+        result.g = (int) (region.mean[1] + 0.5);
+        result.b = (int) (region.mean[2] + 0.5);
+        for(unsigned int i = 0; i < count && result.type == NULL; i++) {
+            const CoinSpec& spec = coinCatalog.GetEntries()[candidates[i]];
+            if(acceptsColor(spec, result.r, result.g, result.b)) {
+                result.type = spec.name.c_str();
+            }
+        }
+    }
+
+    if(result.type != NULL) {
+        progress("   Object %10d - Length: %18ld - Type: %20s\n", number, max_size, result.type);
+        progress("      Averages: R=%d G=%d B=%d - Deviations: R=%.1f G=%.1f B=%.1f - Roundness: %.3f\n", result.r, result.g, result.b,
+            sqrt(region.variance[0]), sqrt(region.variance[1]), sqrt(region.variance[2]), region.roundness);
+        results.push_back(result);
+    } else if(SHOW_ALL_OUTPUT) {
+        progress("   Object %10d - Length: %18ld - Type: %20s\n", number, max_size, "INDEFINIDO");
+    }
+}
+
+/* Fill the bounding box of each coin, one row span at a time: white for 1 real, black for the
+   others. Boxes are clipped to the buffered region. */
+void annotateResults(ImageType::Pointer image, const std::vector<CoinResult>& results) {
+    ImageType::PixelType* buffer = image->GetBufferPointer();
+    ImageType::RegionType buffered = image->GetBufferedRegion();
+    long regionStart[2];
+    long regionEnd[2];
+    for(unsigned int d = 0; d < 2; d++) {
+        regionStart[d] = buffered.GetIndex()[d];
+        regionEnd[d] = regionStart[d] + (long) buffered.GetSize()[d];
+    }
+    for(size_t i = 0; i < results.size(); i++) {
+        ImageType::PixelType value = strcmp(results[i].type, "1 REAL") ? 0 : 255;
+        long x0 = std::max<long>(results[i].x, regionStart[0]);
+        long x1 = std::min<long>((long) results[i].x + results[i].width, regionEnd[0]);
+        long y0 = std::max<long>(results[i].y, regionStart[1]);
+        long y1 = std::min<long>((long) results[i].y + results[i].height, regionEnd[1]);
+        if(x0 >= x1) {
+            continue;
+        }
+        ImageType::IndexType pixelIndex;
+        pixelIndex[0] = x0;
+        for(long y = y0; y < y1; y++) {
+            pixelIndex[1] = y;
+            memset(buffer + image->ComputeOffset(pixelIndex), value, (x1 - x0) * sizeof(ImageType::PixelType));
+        }
+    }
+}
+
+/* Threshold, closing and invert. Coins are the foreground of the output, the closed image is
+   its input. */
+InvertIntensityImageFilterType::Pointer segmentImage(ImageType::Pointer image, int radius, const ScanOptions& options) {
+    /* Use a threshold filter to create a binary image */
+    BinaryThresholdImageFilterType::Pointer thresholdFilter  = applyThresholdFilter(image, THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0);
+  
+    /* Apply a binary morphological closing filter to remove noise */
+    ImageType::Pointer closedImage = applyClosing(thresholdFilter->GetOutput(), radius, options.closingEngine);
+    
+    /* Invert image */
+    return invertImage(closedImage, 255);
+}
+
+/* Threshold and closing in place, coins are the 0 pixels of the result */
+ImageType::Pointer segmentImageInPlace(ImageType::Pointer image, int radius, const ScanOptions& options) {
+    StageProbe stage("threshold", "Applying Threshold filter in place");
+    BinaryThresholdImageFilterType::Pointer thresholdFilter = BinaryThresholdImageFilterType::New();
+    thresholdFilter->SetInput(image);
+    thresholdFilter->SetLowerThreshold(THRESHOLD_LOWER);
+    thresholdFilter->SetUpperThreshold(THRESHOLD_UPPER);
+    thresholdFilter->SetInsideValue(255);
+    thresholdFilter->SetOutsideValue(0);
+    thresholdFilter->InPlaceOn();
+    thresholdFilter->Update();
+    ImageType::Pointer thresholdImage = thresholdFilter->GetOutput();
+    thresholdImage->DisconnectPipeline();
+    stage.Done(thresholdImage->GetLargestPossibleRegion().GetNumberOfPixels());
+
+    return applyClosingInPlace(thresholdImage, radius, options);
+}
+
+/* Closing of a threshold mask with the least memory */
+ImageType::Pointer applyClosingInPlace(ImageType::Pointer mask, int radius, const ScanOptions& options) {
+    if(options.closingEngine == CLOSING_FAST) {
+        StageProbe closingStage("closing fast", "Applying FastClosing filter in place");
+        ImageType::SizeType size = mask->GetLargestPossibleRegion().GetSize();
+        fastBinaryClosing(mask->GetBufferPointer(), mask->GetBufferPointer(), size[0], size[1], radius, itk::NumericTraits<ImageType::PixelType>::max());
+        mask->Modified();
+        closingStage.Done(mask->GetLargestPossibleRegion().GetNumberOfPixels());
+        return mask;
+    }
+
+    // The comparison runs both engines on the threshold output, so it is kept then
+    if(options.closingEngine == CLOSING_ITK) {
+        mask->ReleaseDataFlagOn();
+    }
+    return applyClosing(mask, radius, options.closingEngine);
+}
+
+/* Coarse to fine scan. Segmentation and labeling run on the image shrunk by 'factor', with the
+   closing radius scaled to match. Objects whose coarse size is close to a coin are segmented
+   again at full resolution, only inside their bounding box grown by twice the closing radius.
+   A closed pixel depends on inputs at most 2 * radius away, so objects whose pixels and
+   neighbours stay that far from the cut borders get the same bounding box, and classification,
+   as in a full scan. */
+void scanPyramid(ImageType::Pointer image, ImageColorType::Pointer imageColor, int radius, int factor, const ScanOptions& options, std::vector<CoinResult>& results) {
+    StageProbe stage("shrink", "Shrinking image");
+    ShrinkImageFilterType::Pointer shrinkFilter = ShrinkImageFilterType::New();
+    shrinkFilter->SetInput(image);
+    shrinkFilter->SetShrinkFactors(factor);
+    shrinkFilter->Update();
+    stage.Done(image->GetLargestPossibleRegion().GetNumberOfPixels());
+
+    int coarseRadius = (radius + factor / 2) / factor;
+    if(coarseRadius < 1) {
+        coarseRadius = 1;
+    }
+    InvertIntensityImageFilterType::Pointer coarseFilter = segmentImage(shrinkFilter->GetOutput(), coarseRadius, options);
+    std::vector<RegionStats> coarseRegions;
+    getRegionStats(coarseFilter->GetOutput(), NULL, ImageType::IndexType(), coarseRegions);
+
+    // Loose length and aspect gates, coarse boxes can be off by 'factor' pixels on each side
+    long minLength = coinCatalog.GetMinLength() - 2 * factor;
+    long maxLength = coinCatalog.GetMaxLength() + 2 * factor;
+
+    ImageType::RegionType imageRegion = image->GetLargestPossibleRegion();
+    long margin = 2 * radius + 4 * factor;
+    std::vector<ImageType::RegionType> found;
+    unsigned int number = 0;
+    progress("> Results: \n");
+
+    for(size_t i = 0; i < coarseRegions.size(); i++) {
+        const RegionStats& coarse = coarseRegions[i];
+        long coarseWidth = coarse.width * factor;
+        long coarseHeight = coarse.height * factor;
+        long coarseLength = std::max(coarseWidth, coarseHeight);
+        if(coarseLength < minLength || coarseLength > maxLength || std::min(coarseWidth, coarseHeight) < 0.7 * coarseLength) {
+            continue;
+        }
+
+        // Full resolution region around the candidate
+        ImageType::IndexType roiIndex;
+        ImageType::SizeType roiSize;
+        bool atStart[2];
+        bool atEnd[2];
+        for(unsigned int d = 0; d < 2; d++) {
+            long imageStart = imageRegion.GetIndex()[d];
+            long imageEnd = imageStart + imageRegion.GetSize()[d];
+            long coarseStart = d == 0 ? coarse.x : coarse.y;
+            long coarseSize = d == 0 ? coarse.width : coarse.height;
+            long start = std::max(imageStart, imageStart + coarseStart * factor - margin);
+            long end = std::min(imageEnd, imageStart + (coarseStart + coarseSize) * factor + margin);
+            roiIndex[d] = start;
+            roiSize[d] = end - start;
+            atStart[d] = start == imageStart;
+            atEnd[d] = end == imageEnd;
+        }
+        ImageType::RegionType roi(roiIndex, roiSize);
+
+        RegionOfInterestImageFilterType::Pointer roiFilter = RegionOfInterestImageFilterType::New();
+        roiFilter->SetInput(image);
+        roiFilter->SetRegionOfInterest(roi);
+        roiFilter->Update();
+        InvertIntensityImageFilterType::Pointer fineFilter = segmentImage(roiFilter->GetOutput(), radius, options);
+        std::vector<RegionStats> fineRegions;
+        getRegionStats(fineFilter->GetOutput(), imageColor, roiIndex, fineRegions);
+
+        for(size_t j = 0; j < fineRegions.size(); j++) {
+            RegionStats& region = fineRegions[j];
+
+            // Skip objects close to a border cut inside the image, they may not be exact
+            bool exact = true;
+            for(unsigned int d = 0; d < 2; d++) {
+                long start = d == 0 ? region.x : region.y;
+                long end = start + (d == 0 ? region.width : region.height);
+                if((!atStart[d] && start <= 2 * radius) || (!atEnd[d] && (long) roiSize[d] - end <= 2 * radius)) {
+                    exact = false;
+                }
+            }
+            if(!exact) {
+                continue;
+            }
+            region.x += roiIndex[0];
+            region.y += roiIndex[1];
+
+            // Neighbouring candidates share objects
+            ImageType::IndexType index;
+            index[0] = region.x;
+            index[1] = region.y;
+            ImageType::SizeType size;
+            size[0] = region.width;
+            size[1] = region.height;
+            ImageType::RegionType box(index, size);
+            if(std::find(found.begin(), found.end(), box) != found.end()) {
+                continue;
+            }
+            found.push_back(box);
+            classifyRegion(region, ++number, results);
+        }
+    }
+}
+
+/* Options of a plain scan */
+ScanOptions defaultScanOptions() {
+    ScanOptions options;
+    options.closingEngine = USE_FAST_CLOSING ? CLOSING_FAST : CLOSING_ITK;
+    options.outputImages = 0;
+    options.pyramidFactor = 1;
+    options.tileSize = 0;
+    options.lowMemory = 0;
+    options.cache = NULL;
+    return options;
+}
+
+/* Store the coins an image scan appended to results, from 'first' on, under its cache key */
+static void storeResults(const ScanOptions& options, const CacheKey& cacheKey, const std::vector<CoinResult>& results, size_t first) {
+    if(options.cache != NULL && !cacheKey.digest.empty()) {
+        options.cache->Store(cacheKey, std::vector<CoinResult>(results.begin() + first, results.end()));
+    }
+}
+
+/* Scan an image file and append the detected coins to results */
+void scanImage(const char* path, const ScanOptions& options, std::vector<CoinResult>& results) {
+    itk::TimeProbe totalTime;
+    itk::TimeProbe decodeTime;
+    totalTime.Start();
+    imageRecordBegin(path);
+
+    /* Cached results skip decoding. Scans that write images always run. */
+    CacheKey cacheKey;
+    size_t firstResult = results.size();
+    if(options.cache != NULL && options.outputImages == 0 && options.cache->Lookup(path, options, cacheKey, results)) {
+        imageRecordEnd();
+        totalTime.Stop();
+        progress("> Time: %s - Total: %.3fs (cached)\n", path, totalTime.GetTotal());
+        return;
+    }
+
+    if(options.tileSize > 0) {
+        /* Bounded memory scan, no full resolution image is kept */
+        scanTiled(path, CLOSING_RADIUS, options, results);
+        storeResults(options, cacheKey, results, firstResult);
+        imageRecordEnd();
+        totalTime.Stop();
+        progress("> Time: %s - Total: %.3fs (tiles of %u pixels) - Peak memory: %ld KB\n", path, totalTime.GetTotal(), options.tileSize, peakResidentMemory());
+        return;
+    }
+
+    /* Read input file with colors, decoded only once. The images outlive the reader, so
+       they can be released early. */
+    decodeTime.Start();
+    ImageType::Pointer image;
+    ImageColorType::Pointer imageColor = readScanImage(path, image);
+    decodeTime.Stop();
+
+    /* Derive the grayscale image from the color buffer only when the scan draws on it or
+       shrinks it, else go straight to the threshold mask. Files with alpha come with their
+       gray image, which the colors can't give. */
+    ImageType::Pointer thresholdImage;
+    if(image.IsNull() && scanNeedsGray(options)) {
+        image = convertToGray(imageColor);
+    } else if(image.IsNull()) {
+        thresholdImage = applyColorThreshold(imageColor, THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0);
+    }
+    scanDecodedImage(image, thresholdImage, imageColor, options, results);
+    storeResults(options, cacheKey, results, firstResult);
+
+    imageRecordEnd();
+    totalTime.Stop();
+    progress("> Time: %s - Total: %.3fs - Decode: %.3fs (single decode) - Peak memory: %ld KB\n", path, totalTime.GetTotal(), decodeTime.GetTotal(), peakResidentMemory());
+}
+
+/* True if the scan needs the gray image */
+bool scanNeedsGray(const ScanOptions& options) {
+    return options.pyramidFactor > 1 || (options.outputImages & OUTPUT_ANNOTATED);
+}
+
+/* Scan a decoded image, from its gray version or threshold mask and its colors */
+void scanDecodedImage(ImageType::Pointer& image, ImageType::Pointer& thresholdImage, ImageColorType::Pointer& imageColor, const ScanOptions& options, std::vector<CoinResult>& results) {
+    unsigned long pixels = (image.IsNotNull() ? image : thresholdImage)->GetLargestPossibleRegion().GetNumberOfPixels();
+    // Coins of earlier images may come before the ones of this one
+    size_t firstResult = results.size();
+    ImageType::Pointer closedImage;
+    if(options.pyramidFactor > 1) {
+        /* Coarse to fine scan */
+        scanPyramid(image, imageColor, CLOSING_RADIUS, options.pyramidFactor, options, results);
+    } else if(options.lowMemory) {
+        /* Threshold and closing in place, the gray image is kept only for the annotated output */
+        if(thresholdImage.IsNotNull()) {
+            closedImage = applyClosingInPlace(thresholdImage, CLOSING_RADIUS, options);
+            thresholdImage = NULL;
+        } else if(options.outputImages & OUTPUT_ANNOTATED) {
+            closedImage = applyClosing(applyThresholdFilter(image, THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0)->GetOutput(), CLOSING_RADIUS, options.closingEngine);
+        } else {
+            closedImage = segmentImageInPlace(image, CLOSING_RADIUS, options);
+            image = NULL;
+        }
+
+        /* Coins are the background of the closed image */
+        std::vector<RegionStats> regions;
+        std::vector<unsigned int> numbers;
+        getCoinRegions(closedImage, imageColor, closedImage->GetBufferedRegion().GetIndex(), 0, regions, numbers);
+
+        /* Release what no output image needs */
+        if(!(options.outputImages & OUTPUT_THRESHOLD)) {
+            closedImage = NULL;
+        }
+        if(!(options.outputImages & OUTPUT_COLOR)) {
+            imageColor = NULL;
+        }
+        progress("> Results: \n");
+        StageProbe stage("classification", NULL);
+        for(size_t i = 0; i < regions.size(); i++) {
+            classifyRegion(regions[i], numbers[i], results);
+        }
+        stage.Done(0, results.size() - firstResult);
+    } else {
+        /* Threshold and closing. There is no invert pass, coins are the background of the
+           closed image. */
+        BinaryThresholdImageFilterType::Pointer thresholdFilter;
+        if(thresholdImage.IsNull()) {
+            thresholdFilter = applyThresholdFilter(image, THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0);
+            thresholdImage = thresholdFilter->GetOutput();
+        }
+        closedImage = applyClosing(thresholdImage, CLOSING_RADIUS, options.closingEngine);
+
+        // Label Map filter
+        if(USE_LABELMAP) {
+            /* Apply an imagetoLabelMap filter to separate objects */
+            BinaryImageToLabelMapFilterType::Pointer binaryImageToLabelMapFilter = getLabelMap(invertImage(closedImage, 255)->GetOutput());
+            progress("> Results: \n");
+            
+            /* Loop over each region in the map */
+            for(unsigned int i = 0; i < binaryImageToLabelMapFilter->GetOutput()->GetNumberOfLabelObjects(); i++) {
+                // Get the ith region
+                BinaryImageToLabelMapFilterType::OutputImageType::LabelObjectType* labelObject = binaryImageToLabelMapFilter->GetOutput()->GetNthLabelObject(i);
+                labelObject->Optimize();
+                
+                // Check if the object size matches any coin
+                const char* objectType;
+                objectType = findCoinTypeSize(labelObject->Size());
+                if(SHOW_ALL_OUTPUT) {
+                    if(objectType == NULL) {
+                        objectType = "INDEFINIDO";
+                    }
+                    progress("   Object %10d - Size: %20ld - Type: %20s\n", i+1, labelObject->Size(), objectType);
+                } else {
+                    if(objectType != NULL) {
+                        progress("   Object %10d - Size: %20ld - Type: %20s\n", i+1, labelObject->Size(), objectType);
+                    }
+                }
+            }
+        }
+        
+        // Region statistics
+        if(USE_REGIONSTATS) {
+            /* Separate the objects, and measure the shape and colors of the coin sized ones */
+            std::vector<RegionStats> regions;
+            std::vector<unsigned int> numbers;
+            getCoinRegions(closedImage, imageColor, closedImage->GetBufferedRegion().GetIndex(), 0, regions, numbers);
+            progress("> Results: \n");
+            
+            /* Loop over each region */
+            StageProbe stage("classification", NULL);
+            for(size_t i = 0; i < regions.size(); i++) {
+                classifyRegion(regions[i], numbers[i], results);
+            }
+            stage.Done(0, results.size() - firstResult);
+        }
+    }
+
+    /* Output images, encoded on the writer thread when it runs */
+    if(options.outputImages != 0) {
+        StageProbe stage("write", "Writing output images");
+        unsigned int written = 0;
+        if(options.outputImages & OUTPUT_ANNOTATED) {
+            annotateResults(image, std::vector<CoinResult>(results.begin() + firstResult, results.end()));
+            writeImage(image, "output.png");
+            written++;
+        }
+        // The pyramid scan has no full resolution closed image
+        if((options.outputImages & OUTPUT_THRESHOLD) && closedImage.IsNotNull()) {
+            writeImage(closedImage, "outputThresh.png");
+            written++;
+        }
+        // Gray caller buffers have no color image
+        if((options.outputImages & OUTPUT_COLOR) && imageColor.IsNotNull()) {
+            writeImage(imageColor, "outputColor.png");
+            written++;
+        }
+        stage.Done(pixels * written);
+    }
+}
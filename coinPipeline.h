@@ -0,0 +1,241 @@
+#ifndef COIN_PIPELINE_H
+#define COIN_PIPELINE_H
+
+/* INCLUDES */
+
+#include "itkImage.h"
+#include "itkBinaryMorphologicalClosingImageFilter.h"
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkImageFileReader.h"
+#include "itkBinaryCrossStructuringElement.h"
+#include "itkBinaryBallStructuringElement.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIterator.h"
+#include "itkBinaryImageToLabelMapFilter.h"
+#include "itkInvertIntensityImageFilter.h"
+#include "itkBinaryImageToShapeLabelMapFilter.h"
+#include <itkBinaryThresholdImageFilter.h>
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include <itkRGBPixel.h>
+#include <itkRGBAPixel.h>
+#include "itkTimeProbe.h"
+#include "itkShrinkImageFilter.h"
+#include "itkRegionOfInterestImageFilter.h"
+#include "coinScanner.h"
+#include "coinCatalog.h"
+#include "regionStats.h"
+#include <vector>
+
+/* COIN LABELS */
+#define MOEDA_1_REAL        0
+#define MOEDA_50_CENT       1
+#define MOEDA_25_CENT       2
+#define MOEDA_10_CENT       3
+#define MOEDA_10_CENT_GOLD  4
+#define MOEDA_5_CENT        5
+#define MOEDA_5_CENT_BRONZE 6
+
+/* COIN PIXEL AMOUNTS */
+#define MOEDA_1_REAL_PIXEL          117000
+#define MOEDA_50_CENT_PIXEL         83000
+#define MOEDA_25_CENT_PIXEL         100000
+#define MOEDA_10_CENT_PIXEL         0
+#define MOEDA_10_CENT_GOLD_PIXEL    63117
+#define MOEDA_5_CENT_PIXEL          0
+#define MOEDA_5_CENT_BRONZE_PIXEL   75000
+
+/* COIN LENGTH */
+#define MOEDA_1_REAL_LENGTH         400
+#define MOEDA_50_CENT_LENGTH        340
+#define MOEDA_25_CENT_LENGTH        360
+#define MOEDA_10_CENT_LENGTH        0
+#define MOEDA_10_CENT_GOLD_LENGTH   286
+#define MOEDA_5_CENT_LENGTH         0
+#define MOEDA_5_CENT_BRONZE_LENGTH  315
+
+/* ERROR MARGIN */
+#define MARGEM_ERRO 0.075
+
+/* SEGMENTATION: coins are the pixels whose gray level is outside the threshold range once
+   the mask is closed */
+#define THRESHOLD_LOWER 10
+#define THRESHOLD_UPPER 100
+#define CLOSING_RADIUS  30
+
+/* OPTIONS */
+#define USE_LABELMAP 0
+#define USE_REGIONSTATS 1
+#define SHOW_ALL_OUTPUT 0
+#define USE_FAST_CLOSING 1
+
+/* ITK Definitions */
+typedef itk::RGBPixel<unsigned char> RGBPixelType;
+typedef itk::Image<unsigned char, 2>  ImageType;
+typedef itk::Image<RGBPixelType> ImageColorType;
+typedef itk::ImageFileReader<ImageType> ReaderType;
+typedef itk::ImageFileReader<ImageColorType> ReaderColorType;
+typedef itk::RGBAPixel<unsigned char> RGBAPixelType;
+typedef itk::Image<RGBAPixelType> ImageRGBAType;
+typedef itk::ImageFileReader<ImageRGBAType> ReaderRGBAType;
+typedef itk::BinaryThresholdImageFilter <ImageType, ImageType>  BinaryThresholdImageFilterType;
+typedef itk::BinaryCrossStructuringElement<ImageType::PixelType, ImageType::ImageDimension> StructuringElementType;
+typedef itk::BinaryBallStructuringElement<ImageType::PixelType, ImageType::ImageDimension> StructuringElementTypeBall;
+typedef itk::BinaryErodeImageFilter <ImageType, ImageType, StructuringElementType> BinaryErodeImageFilterType;
+typedef itk::BinaryMorphologicalClosingImageFilter <ImageType, ImageType, StructuringElementType> BinaryMorphologicalClosingImageFilterType;
+typedef itk::InvertIntensityImageFilter <ImageType> InvertIntensityImageFilterType;
+typedef itk::BinaryImageToLabelMapFilter<ImageType> BinaryImageToLabelMapFilterType;
+typedef itk::BinaryImageToShapeLabelMapFilter<ImageType> BinaryImageToShapeLabelMapFilterType;
+typedef itk::ShrinkImageFilter<ImageType, ImageType> ShrinkImageFilterType;
+typedef itk::RegionOfInterestImageFilter<ImageType, ImageType> RegionOfInterestImageFilterType;
+
+/* Coins to detect, the built in ones unless a catalog file was loaded */
+extern CoinCatalog coinCatalog;
+
+/* @FUNCTIONS    */
+
+/* Mark the calling thread as a worker of a parallel scan, or not anymore: its progress lines
+   are skipped and the ITK filters it runs are single threaded. Unlike showProgress and the
+   ITK default thread count, this doesn't affect scans running on other threads. */
+void setScanWorker(bool worker);
+
+/* Create reader from file */
+ReaderType::Pointer readFromFile(char* path);
+
+/* Create reader from file */
+ReaderColorType::Pointer readColorFromFile(char* path);
+
+/* Decode an image file for a scan: its colors, as the color reader gives them, and the gray
+   image when the colors alone can't give it bit for bit. RGBA files are decoded once as RGBA,
+   and 'gray' is their gray image with alpha applied, as reading them directly as ImageType
+   does; gray plus alpha files, which ITK converts to colors with its own alpha rules, are read
+   a second time as gray. For other files 'gray' is set to NULL: convertToGray() of the colors
+   is identical to the direct gray read. */
+ImageColorType::Pointer readScanImage(const char* path, ImageType::Pointer& gray);
+
+/* True if ITK's gray read of a file with this number of components uses an alpha channel */
+bool hasAlphaChannel(unsigned int components);
+
+/* Create grayscale image from a decoded color image. Uses the same luminance weights and
+   truncation as ITK's RGB to scalar conversion, so the result matches reading the file
+   directly as ImageType for files without alpha (see readScanImage). */
+ImageType::Pointer convertToGray(ImageColorType::Pointer src);
+
+/* Same into an existing gray image, whose buffer is reused if it already has the size of src */
+void convertToGray(ImageColorType::Pointer src, ImageType::Pointer gray);
+
+/* Same from interleaved RGB rows 'rgbStride' bytes apart, into an allocated gray image of the
+   size to convert */
+void convertToGray(const unsigned char* rgb, long rgbStride, ImageType::Pointer gray);
+
+/* Binary threshold filter */
+BinaryThresholdImageFilterType::Pointer applyThresholdFilter(ImageType::Pointer src, int lowerThreshold, int upperThreshold, int insideValue, int outsideValue);
+
+/* Same from 8 bit gray rows 'grayStride' bytes apart, into a new mask of 'size' */
+ImageType::Pointer applyThreshold(const unsigned char* gray, long grayStride, const ImageType::SizeType& size, int lowerThreshold, int upperThreshold, int insideValue, int outsideValue);
+
+/* Gray conversion and binary threshold fused in one pass over the colors, by the vector kernel
+   of thresholdMask.h. The mask is identical to convertToGray then applyThresholdFilter, without
+   the gray image. */
+ImageType::Pointer applyColorThreshold(ImageColorType::Pointer src, int lowerThreshold, int upperThreshold, int insideValue, int outsideValue);
+
+/* Same from interleaved RGB rows 'rgbStride' bytes apart, into a new mask of 'size' */
+ImageType::Pointer applyColorThreshold(const unsigned char* rgb, long rgbStride, const ImageType::SizeType& size, int lowerThreshold, int upperThreshold, int insideValue, int outsideValue);
+
+/* Binary erode filter */
+BinaryErodeImageFilterType::Pointer applyErodeFilter(ImageType::Pointer src, int radius);
+
+/* Binary morphological filter */
+BinaryMorphologicalClosingImageFilterType::Pointer applyMorphologicalClosingFilter(ImageType::Pointer src, int radius);
+
+/* Binary morphological closing using the radius independent cross closing */
+ImageType::Pointer applyFastClosingFilter(ImageType::Pointer src, int radius);
+
+/* Run the selected closing engine. CLOSING_COMPARE runs both on the same input, reports their
+   times and the number of different pixels, and continues with the fast result. */
+ImageType::Pointer applyClosing(ImageType::Pointer src, int radius, int engine);
+
+/* Invert image */
+InvertIntensityImageFilterType::Pointer invertImage(ImageType::Pointer src, int maximum);
+
+/* Create LabelMap from image */
+BinaryImageToLabelMapFilterType::Pointer getLabelMap(ImageType::Pointer src);
+
+/* Create ShapeLabelMap from image */
+BinaryImageToShapeLabelMapFilterType::Pointer getShapeLabelMap(ImageType::Pointer src);
+
+/* Label the objects of a binary image (pixels equal to 'foreground') and measure them in one
+   pass. Colors are averaged over each object mask from imageColor, whose pixel at 'colorIndex'
+   lies under the first pixel of src; with a null imageColor they are not measured. */
+void getRegionStats(ImageType::Pointer src, ImageColorType::Pointer imageColor, const ImageType::IndexType& colorIndex, std::vector<RegionStats>& regions, int foreground = 255);
+
+/* Label the objects of a binary image with the run labeler, on one band of rows per thread, and
+   measure the perimeter and colors only of the objects that may be coins (all of them with
+   SHOW_ALL_OUTPUT). Their statistics are returned with their numbers, 1 + their index in
+   raster order of all the objects. */
+void getCoinRegions(ImageType::Pointer src, ImageColorType::Pointer imageColor, const ImageType::IndexType& colorIndex, int foreground, std::vector<RegionStats>& regions, std::vector<unsigned int>& numbers);
+
+/* Closest coin matching a given pixel amount */
+const char* findCoinTypeSize(long int size);
+
+/* Closest coin matching a given length */
+const char* findCoinTypeLength(long int length);
+
+/* Classify an object by the largest side of its bounding box. Sets length, and elongated for
+   objects that can't be coins. Returns the closest coin name, or NULL if no coin matches. */
+const char* classifyBox(unsigned int width, unsigned int height, long* length, bool* elongated);
+
+/* Classify a measured object, in image coordinates. The closest coin whose length and color
+   ranges accept it is appended to results, other objects are ignored. */
+void classifyRegion(const RegionStats& region, unsigned int number, std::vector<CoinResult>& results);
+
+/* True if an object with this bounding box is not elongated and some coin accepts its length */
+bool isCoinCandidate(unsigned int width, unsigned int height);
+
+/* Fill the bounding box of each coin, one row span at a time: white for 1 real, black for the
+   others. Boxes are clipped to the buffered region. */
+void annotateResults(ImageType::Pointer image, const std::vector<CoinResult>& results);
+
+/* Threshold, closing and invert. Coins are the foreground of the output, the closed image is
+   its input. */
+InvertIntensityImageFilterType::Pointer segmentImage(ImageType::Pointer image, int radius, const ScanOptions& options);
+
+/* Threshold and closing with the least memory. The threshold runs in place, so 'image' is
+   released, and the fast closing runs in place on its output; with the ITK closing the
+   threshold output is released once the closing has run. There is no invert pass: coins are
+   the 0 pixels of the closed image returned, which is labeled with foreground 0. */
+ImageType::Pointer segmentImageInPlace(ImageType::Pointer image, int radius, const ScanOptions& options);
+
+/* Closing of a threshold mask with the least memory: the fast closing runs in place, the ITK
+   closing releases the mask once it has run */
+ImageType::Pointer applyClosingInPlace(ImageType::Pointer mask, int radius, const ScanOptions& options);
+
+/* Coarse to fine scan. Segmentation and labeling run on the image shrunk by 'factor', with the
+   closing radius scaled to match. Objects whose coarse size is close to a coin are segmented
+   again at full resolution, only inside their bounding box grown by twice the closing radius.
+   A closed pixel depends on inputs at most 2 * radius away, so objects whose pixels and
+   neighbours stay that far from the cut borders get the same bounding box, and classification,
+   as in a full scan. */
+void scanPyramid(ImageType::Pointer image, ImageColorType::Pointer imageColor, int radius, int factor, const ScanOptions& options, std::vector<CoinResult>& results);
+
+/* Bounded memory scan. The image is cut in tiles of options.tileSize pixels, each one read with a
+   halo of twice the closing radius plus one pixel, segmented and labeled on its own by a pool of worker
+   threads. Objects cut by the tile borders are joined through the labels on both sides of each
+   seam and their measures added up, so the objects are the ones of a full scan. Only formats
+   ITK can read by region (MetaImage, NRRD) are accepted, others (PNG, JPEG, BMP, and TIFF in
+   ITK 4) throw itk::ExceptionObject rather than being decoded whole. */
+void scanTiled(const char* path, int radius, const ScanOptions& options, std::vector<CoinResult>& results);
+
+/* True if a scan with these options needs the gray image: the pyramid scan shrinks it and the
+   annotated output is drawn on it. Other scans only need its threshold mask. */
+bool scanNeedsGray(const ScanOptions& options);
+
+/* Scan a decoded image, as scanImage does after decoding (the tile size is not used). Either
+   'image', the gray version, or 'thresholdImage', its mask from applyColorThreshold() with
+   the THRESHOLD_* bounds and 255 / 0, is given, the gray image when scanNeedsGray().
+   imageColor may have wider rows, its first pixel lies under the first one of the image. In
+   low memory mode the images are released, set to NULL, as soon as no output image needs
+   them. */
+void scanDecodedImage(ImageType::Pointer& image, ImageType::Pointer& thresholdImage, ImageColorType::Pointer& imageColor, const ScanOptions& options, std::vector<CoinResult>& results);
+
+#endif
@@ -1,439 +1,196 @@
 /* INCLUDES */
 
-#include "itkImage.h"
-#include "itkBinaryMorphologicalClosingImageFilter.h"
-#include "itkBinaryThresholdImageFilter.h"
-#include "itkImageFileReader.h"
-#include "itkBinaryCrossStructuringElement.h"
-#include "itkBinaryBallStructuringElement.h"
-#include "itkImageFileWriter.h"
-#include "itkImageRegionIterator.h"
-#include "itkBinaryImageToLabelMapFilter.h"
-#include "itkInvertIntensityImageFilter.h"
-#include "itkBinaryImageToShapeLabelMapFilter.h"
-#include <itkBinaryThresholdImageFilter.h>
-#include "itkImageRegionConstIterator.h"
-#include "itkImageRegionIterator.h"
-#include <itkRGBPixel.h>
-#include <iostream>
+#include "coinPipeline.h"
+#include "instrumentation.h"
+#include "outputWriter.h"
+#include "resultCache.h"
+#include <itksys/SystemTools.hxx>
 #include <stdio.h>
-
-#define INFINI 100000000
-
-/* COIN LABELS */
-#define MOEDA_1_REAL        0
-#define MOEDA_50_CENT       1
-#define MOEDA_25_CENT       2
-#define MOEDA_10_CENT       3
-#define MOEDA_10_CENT_GOLD  4
-#define MOEDA_5_CENT        5
-#define MOEDA_5_CENT_BRONZE 6
-
-/* COIN PIXEL AMOUNTS */
-#define MOEDA_1_REAL_PIXEL          117000
-#define MOEDA_50_CENT_PIXEL         83000
-#define MOEDA_25_CENT_PIXEL         100000
-#define MOEDA_10_CENT_PIXEL         0
-#define MOEDA_10_CENT_GOLD_PIXEL    63117
-#define MOEDA_5_CENT_PIXEL          0
-#define MOEDA_5_CENT_BRONZE_PIXEL   75000
-
-/* COIN LENGTH */
-#define MOEDA_1_REAL_LENGTH         400
-#define MOEDA_50_CENT_LENGTH        340
-#define MOEDA_25_CENT_LENGTH        360
-#define MOEDA_10_CENT_LENGTH        0
-#define MOEDA_10_CENT_GOLD_LENGTH   286
-#define MOEDA_5_CENT_LENGTH         0
-#define MOEDA_5_CENT_BRONZE_LENGTH  315
-
-/* ERROR MARGIN */
-#define MARGEM_ERRO 0.075
-
-/* OPTIONS */
-#define USE_LABELMAP 0
-#define USE_SHAPELABELMAP 1
-#define SHOW_ALL_OUTPUT 0
-
-/* ITK Definitions */
-typedef itk::RGBPixel<unsigned char> RGBPixelType;
-typedef itk::Image<unsigned char, 2>  ImageType;
-typedef itk::Image<RGBPixelType> ImageColorType;
-typedef itk::ImageFileReader<ImageType> ReaderType;
-typedef itk::ImageFileReader<ImageColorType> ReaderColorType;
-typedef itk::BinaryThresholdImageFilter <ImageType, ImageType>  BinaryThresholdImageFilterType;
-typedef itk::BinaryCrossStructuringElement<ImageType::PixelType, ImageType::ImageDimension> StructuringElementType;
-typedef itk::BinaryBallStructuringElement<ImageType::PixelType, ImageType::ImageDimension> StructuringElementTypeBall;
-typedef itk::BinaryErodeImageFilter <ImageType, ImageType, StructuringElementType> BinaryErodeImageFilterType;
-typedef itk::BinaryMorphologicalClosingImageFilter <ImageType, ImageType, StructuringElementType> BinaryMorphologicalClosingImageFilterType;
-typedef itk::InvertIntensityImageFilter <ImageType> InvertIntensityImageFilterType;
-typedef itk::BinaryImageToLabelMapFilter<ImageType> BinaryImageToLabelMapFilterType;
-typedef itk::BinaryImageToShapeLabelMapFilter<ImageType> BinaryImageToShapeLabelMapFilterType;
+#include <stdlib.h>
+#include <string.h>
 
 /* @FUNCTIONS    */
 
-/* Create reader from file */
-ReaderType::Pointer readFromFile(char* path) {
-    printf("> Reading file: %s... ", path);
-    ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileName(path);
-    reader->Update();
-    printf("[DONE]\n");
-    
-    return reader;
-}
-
-/* Create reader from file */
-ReaderColorType::Pointer readColorFromFile(char* path) {
-    printf("> Reading file: %s... ", path);
-    ReaderColorType::Pointer reader = ReaderColorType::New();
-    reader->SetFileName(path);
-    reader->Update();
-    printf("[DONE]\n");
-    
-    return reader;
-}
-
-/* Binary threshold filter */
-BinaryThresholdImageFilterType::Pointer applyThresholdFilter(ImageType::Pointer src, int lowerThreshold, int upperThreshold, int insideValue, int outsideValue) {
-    printf("> Applying Threshold filter... ");
-    BinaryThresholdImageFilterType::Pointer thresholdFilter  = BinaryThresholdImageFilterType::New();
-    thresholdFilter->SetInput(src);
-    thresholdFilter->SetLowerThreshold(lowerThreshold);
-    thresholdFilter->SetUpperThreshold(upperThreshold);
-    thresholdFilter->SetInsideValue(insideValue);
-    thresholdFilter->SetOutsideValue(outsideValue);
-    printf("[DONE]\n");
-    
-    return thresholdFilter;
-}
-
-/* Binary erode filter */
-BinaryErodeImageFilterType::Pointer applyErodeFilter(ImageType::Pointer src, int radius) {
-    printf("> Applying Erode filter... ");
-    // Create structure
-    StructuringElementType structuringElement;
-    structuringElement.SetRadius(radius);
-    structuringElement.CreateStructuringElement();
-    // Run filter    
-    BinaryErodeImageFilterType::Pointer closingFilter  = BinaryErodeImageFilterType::New();
-    closingFilter->SetInput(src);
-    closingFilter->SetKernel(structuringElement);
-    closingFilter->Update();
-    printf("[DONE]\n");
-    
-    return closingFilter;
-}
-
-/* Binary morphological filter */
-BinaryMorphologicalClosingImageFilterType::Pointer applyMorphologicalClosingFilter(ImageType::Pointer src, int radius) {
-    printf("> Applying MorphologicalClosing filter... ");
-    // Create structure
-    StructuringElementType structuringElement;
-    structuringElement.SetRadius(radius);
-    structuringElement.CreateStructuringElement();
-    // Run filter    
-    BinaryMorphologicalClosingImageFilterType::Pointer closingFilter  = BinaryMorphologicalClosingImageFilterType::New();
-    closingFilter->SetInput(src);
-    closingFilter->SetKernel(structuringElement);
-    closingFilter->Update();
-    printf("[DONE]\n");
-    
-    return closingFilter;
-}
-
-/* Invert image */
-InvertIntensityImageFilterType::Pointer invertImage(ImageType::Pointer src, int maximum) {
-    printf("> Applying Invert filter... ");
-    InvertIntensityImageFilterType::Pointer invertIntensityFilter = InvertIntensityImageFilterType::New();
-    invertIntensityFilter->SetInput(src);
-    invertIntensityFilter->SetMaximum(maximum);
-    printf("[DONE]\n");
-    
-    return invertIntensityFilter;
-}
-
-/* Create LabelMap from image */
-BinaryImageToLabelMapFilterType::Pointer getLabelMap(ImageType::Pointer src) {
-    printf("> Creating LabelMap... ");
-    BinaryImageToLabelMapFilterType::Pointer binaryImageToLabelMapFilter = BinaryImageToLabelMapFilterType::New();
-    binaryImageToLabelMapFilter->SetInput(src);
-    binaryImageToLabelMapFilter->Update();
-    printf("[DONE]\n");
-    
-    return binaryImageToLabelMapFilter;
+/* Print the cache statistics, if a cache was used, and release it */
+static void reportCache(ResultCache* cache) {
+    if(cache != NULL) {
+        cache->Report();
+        delete cache;
+    }
 }
 
-BinaryImageToShapeLabelMapFilterType::Pointer getShapeLabelMap(ImageType::Pointer src) {
-    printf("> Creating ShapeLabelMap... ");
-    BinaryImageToShapeLabelMapFilterType::Pointer binaryImageToShapeLabelMapFilter = BinaryImageToShapeLabelMapFilterType::New();
-    binaryImageToShapeLabelMapFilter->SetInput(src);
-    binaryImageToShapeLabelMapFilter->Update();
-    printf("[DONE]\n");
-    
-    return binaryImageToShapeLabelMapFilter;
-}
+/* @MAIN */
+int main(int argc, char *argv[]){
 
-/* Comparison using an error margin. If is inside the margin return the difference, if not return INFINI.*/
-long int compare(long int size, long int compareValue){ 
-    if(size < (compareValue + compareValue*MARGEM_ERRO) && size > (compareValue - compareValue*MARGEM_ERRO)) {
-        long int diff = size - compareValue;
-        if(diff < 0) {
-            diff *= -1;
-        }
-        if(diff == 0) {
-            diff = 1;
+    /* Check arguments */
+    char* path = NULL;
+    char* batchSource = NULL;
+    unsigned int threads = 0;
+    const char* statsPath = NULL;
+    const char* catalogPath = NULL;
+    const char* calibrationDirectory = NULL;
+    const char* videoSource = NULL;
+    const char* serverSocket = NULL;
+    const char* cacheDirectory = NULL;
+    unsigned long cacheMegabytes = 256;
+    VideoOptions video;
+    video.width = 0;
+    video.height = 0;
+    video.refresh = 30;
+    ScanOptions options = defaultScanOptions();
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--closing=itk")) {
+            options.closingEngine = CLOSING_ITK;
+        } else if(!strcmp(argv[i], "--closing=fast")) {
+            options.closingEngine = CLOSING_FAST;
+        } else if(!strcmp(argv[i], "--closing=compare")) {
+            options.closingEngine = CLOSING_COMPARE;
+        } else if(!strncmp(argv[i], "--output=", 9)) {
+            std::vector<std::string> kinds;
+            itksys::SystemTools::Split(argv[i] + 9, kinds, ',');
+            for(size_t k = 0; k < kinds.size(); k++) {
+                if(kinds[k] == "annotated") {
+                    options.outputImages |= OUTPUT_ANNOTATED;
+                } else if(kinds[k] == "threshold") {
+                    options.outputImages |= OUTPUT_THRESHOLD;
+                } else if(kinds[k] == "color") {
+                    options.outputImages |= OUTPUT_COLOR;
+                } else if(kinds[k] == "all") {
+                    options.outputImages |= OUTPUT_ALL;
+                } else if(kinds[k] != "none") {
+                    printf("Unknown output image: %s\n", kinds[k].c_str());
+                    return 1;
+                }
+            }
+        } else if(!strncmp(argv[i], "--compression=", 14)) {
+            int level = atoi(argv[i] + 14);
+            if(level < 1 || level > 9) {
+                printf("Invalid compression level: %s (1 to 9)\n", argv[i] + 14);
+                return 1;
+            }
+            setOutputCompression(level);
+        } else if(!strncmp(argv[i], "--pyramid=", 10)) {
+            options.pyramidFactor = atoi(argv[i] + 10);
+        } else if(!strncmp(argv[i], "--tiles=", 8)) {
+            options.tileSize = atoi(argv[i] + 8);
+            if(options.tileSize < 64) {
+                printf("Invalid tile size: %s (64 or more)\n", argv[i] + 8);
+                return 1;
+            }
+        } else if(!strcmp(argv[i], "--low-memory")) {
+            options.lowMemory = 1;
+        } else if(!strncmp(argv[i], "--cache=", 8)) {
+            cacheDirectory = argv[i] + 8;
+        } else if(!strncmp(argv[i], "--cache-size=", 13)) {
+            cacheMegabytes = strtoul(argv[i] + 13, NULL, 10);
+            if(cacheMegabytes < 1) {
+                printf("Invalid cache size: %s (1 MB or more)\n", argv[i] + 13);
+                return 1;
+            }
+        } else if(!strncmp(argv[i], "--batch=", 8)) {
+            batchSource = argv[i] + 8;
+        } else if(!strncmp(argv[i], "--threads=", 10)) {
+            threads = atoi(argv[i] + 10);
+        } else if(!strcmp(argv[i], "--stats")) {
+            statsPath = "";
+        } else if(!strncmp(argv[i], "--stats=", 8)) {
+            statsPath = argv[i] + 8;
+        } else if(!strncmp(argv[i], "--serve=", 8)) {
+            serverSocket = argv[i] + 8;
+        } else if(!strncmp(argv[i], "--video=", 8)) {
+            videoSource = argv[i] + 8;
+        } else if(!strncmp(argv[i], "--frame-size=", 13)) {
+            if(sscanf(argv[i] + 13, "%ux%u", &video.width, &video.height) != 2) {
+                printf("Invalid frame size: %s\n", argv[i] + 13);
+                return 1;
+            }
+        } else if(!strncmp(argv[i], "--refresh=", 10)) {
+            video.refresh = atoi(argv[i] + 10);
+        } else if(!strncmp(argv[i], "--catalog=", 10)) {
+            catalogPath = argv[i] + 10;
+        } else if(!strncmp(argv[i], "--calibrate=", 12)) {
+            calibrationDirectory = argv[i] + 12;
+        } else if(!strncmp(argv[i], "--", 2)) {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        } else {
+            path = argv[i];
         }
-        return diff;
-    } else {
-        return INFINI;
-    }
-}
-  
-/* Compare a given pixel amount with the defined pixel amounts for each coin */
-char* findCoinTypeSize(long int size) {
-    long int closest = INFINI;
-    char* closest_string = NULL;
-    if(compare(size, MOEDA_1_REAL_PIXEL) < closest) {
-        closest = compare(size, MOEDA_1_REAL_PIXEL);
-        closest_string = (char *) "1 REAL";
-    }
-    if(compare(size, MOEDA_50_CENT_PIXEL) < closest) {
-        closest = compare(size, MOEDA_50_CENT_PIXEL);
-        closest_string = (char *) "50 CENTAVOS";
-    }
-    if(compare(size, MOEDA_25_CENT_PIXEL) < closest) {
-        closest = compare(size, MOEDA_25_CENT_PIXEL);
-        closest_string = (char *) "25 CENTAVOS";
     }
-    if(compare(size, MOEDA_10_CENT_PIXEL) < closest) {
-        closest = compare(size, MOEDA_10_CENT_PIXEL);
-        closest_string = (char *) "10 CENTAVOS";
-    }
-    if(compare(size, MOEDA_10_CENT_GOLD_PIXEL) < closest) {
-        closest = compare(size, MOEDA_10_CENT_GOLD_PIXEL);
-        closest_string = (char *) "10 CENTAVOS GOLD";
-    }
-    if(compare(size, MOEDA_5_CENT_PIXEL) < closest) {
-        closest = compare(size, MOEDA_5_CENT_PIXEL);
-        closest_string = (char *) "5 CENTAVOS";
-    }
-    if(compare(size, MOEDA_5_CENT_BRONZE_PIXEL) < closest) {
-        closest = compare(size, MOEDA_5_CENT_BRONZE_PIXEL);
-        closest_string = (char *) "5 CENTAVOS BRONZE";
-    }
-    return closest_string;
-}
 
-/* Compare a given length with the defined lengths for each coin */
-char* findCoinTypeLength(long int length) {
-    long int closest = INFINI;
-    char* closest_string = NULL;
-    if(compare(length, MOEDA_1_REAL_LENGTH) < closest) {
-        closest = compare(length, MOEDA_1_REAL_LENGTH);
-        closest_string = (char *) "1 REAL";
+    /* Calibration mode */
+    if(calibrationDirectory != NULL) {
+        return runCalibration(calibrationDirectory, options);
     }
-    if(compare(length, MOEDA_50_CENT_LENGTH) < closest) {
-        closest = compare(length, MOEDA_50_CENT_LENGTH);
-        closest_string = (char *) "50 CENTAVOS";
-    }
-    if(compare(length, MOEDA_25_CENT_LENGTH) < closest) {
-        closest = compare(length, MOEDA_25_CENT_LENGTH);
-        closest_string = (char *) "25 CENTAVOS";
-    }
-    if(compare(length, MOEDA_10_CENT_LENGTH) < closest) {
-        closest = compare(length, MOEDA_10_CENT_LENGTH);
-        closest_string = (char *) "10 CENTAVOS";
-    }
-    if(compare(length, MOEDA_10_CENT_GOLD_LENGTH) < closest) {
-        closest = compare(length, MOEDA_10_CENT_GOLD_LENGTH);
-        closest_string = (char *) "10 CENTAVOS GOLD";
-    }
-    if(compare(length, MOEDA_5_CENT_LENGTH) < closest) {
-        closest = compare(length, MOEDA_5_CENT_LENGTH);
-        closest_string = (char *) "5 CENTAVOS";
-    }
-    if(compare(length, MOEDA_5_CENT_BRONZE_LENGTH) < closest) {
-        closest = compare(length, MOEDA_5_CENT_BRONZE_LENGTH);
-        closest_string = (char *) "5 CENTAVOS BRONZE";
-    }
-    return closest_string;
-}
-
-/* Color Scan */
-void colorScan(ImageColorType::Pointer image, unsigned int x, unsigned int y, unsigned int x_length, unsigned int y_length) {
-    //printf("   > Scanning object color pattern X=%d Y=%d X_LENGTH=%d Y_LENGTH=%d...", x, y, x_length, y_length);
-    int lineWidth = 9;
-    ImageColorType::SizeType regionSize;
-    //regionSize[0] = x_length;
-    //regionSize[1] = lineWidth;
-    regionSize[0] = lineWidth;
-    regionSize[1] = y_length;
-
-    ImageColorType::IndexType regionIndex;
-    //regionIndex[0] = x;
-    //regionIndex[1] = y + floor(y_length/2) - floor(lineWidth/2);
-
-    regionIndex[0] = x + floor(x_length/2) - floor(lineWidth/2);
-    regionIndex[1] = y;
 
-    ImageColorType::RegionType region;
-    region.SetSize(regionSize);
-    region.SetIndex(regionIndex);
-
-    itk::ImageRegionIterator<ImageColorType> imageIterator(image,region);
-    //itk::ImageRegionConstIterator<ImageType> imageIterator(image,image->GetLargestPossibleRegion());
-
-    int r = 0;
-    int g = 0;
-    int b = 0;
-
-    while(!imageIterator.IsAtEnd()) {
-
-        itk::RGBPixel<unsigned char> pixelArray;
-        pixelArray = 1, 1, 1;
-        // Get the value of the current pixel
-        r += (int) imageIterator.Get()[0];
-        g += (int) imageIterator.Get()[1];
-        b += (int) imageIterator.Get()[2];
-        imageIterator.Set(pixelArray);
-
-        ++imageIterator;
+    /* Coin catalog */
+    std::string error;
+    if(catalogPath != NULL && !coinCatalog.Load(catalogPath, error)) {
+        printf("Could not load coin catalog: %s\n", error.c_str());
+        return 1;
     }
-    r = floor(r / (x_length+1)) / lineWidth;
-    g = floor(g / (x_length+1)) / lineWidth;
-    b = floor(b / (x_length+1)) / lineWidth;
-    //printf("[DONE]\n");
-    printf("      Averages: R=%d G=%d B=%d\n", r, g, b);
-}
 
-/* @MAIN */
-int main(int argc, char *argv[]){
+    /* Result cache, keyed by the catalog too so it is opened after loading it */
+    ResultCache* cache = NULL;
+    if(cacheDirectory != NULL) {
+        cache = new ResultCache(cacheDirectory, cacheMegabytes * 1024 * 1024);
+        if(!cache->Open(error)) {
+            printf("Could not open result cache: %s\n", error.c_str());
+            return 1;
+        }
+        options.cache = cache;
+    }
 
-    /* Check arguments */
-    if(argc < 2) {
-        printf("Usage: %s [FILE PATH]\n", argv[0]); 
+    /* Stage instrumentation */
+    if(statsPath != NULL && !instrumentationStart(statsPath)) {
+        printf("Could not open stats file: %s\n", statsPath);
         return 1;
     }
-    
-    /* Read input file */
-    ReaderType::Pointer reader = readFromFile(argv[1]);
-    
-    ImageType::Pointer image = reader->GetOutput();
-
-    /* Read input file with colors */
-    ReaderColorType::Pointer readerColor = readColorFromFile(argv[1]);
 
-    ImageColorType::Pointer imageColor = readerColor->GetOutput();
- 
-    /* Use a threshold filter to create a binary image */
-    BinaryThresholdImageFilterType::Pointer thresholdFilter  = applyThresholdFilter(reader->GetOutput(), 10, 100, 255, 0);
-  
-    /* Apply a binary morphological closing filter to remove noise */
-    BinaryMorphologicalClosingImageFilterType::Pointer closingFilter = applyMorphologicalClosingFilter(thresholdFilter->GetOutput(), 30);
-    
-    /* Invert image */
-    InvertIntensityImageFilterType::Pointer invertIntensityFilter = invertImage(closingFilter->GetOutput(), 255);
-
-    // Label Map filter
-    if(USE_LABELMAP) {
-        /* Apply an imagetoLabelMap filter to separate objects */
-        BinaryImageToLabelMapFilterType::Pointer binaryImageToLabelMapFilter = getLabelMap(invertIntensityFilter->GetOutput());
-        printf("> Results: \n");
-        
-        /* Loop over each region in the map */
-        for(unsigned int i = 0; i < binaryImageToLabelMapFilter->GetOutput()->GetNumberOfLabelObjects(); i++) {
-            // Get the ith region
-            BinaryImageToLabelMapFilterType::OutputImageType::LabelObjectType* labelObject = binaryImageToLabelMapFilter->GetOutput()->GetNthLabelObject(i);
-            labelObject->Optimize();
-            
-            // Check if the object size matches any coin
-            char* objectType;
-            objectType = findCoinTypeSize(labelObject->Size());
-            if(SHOW_ALL_OUTPUT) {
-                if(objectType == NULL) {
-                    objectType = (char*) "INDEFINIDO";
-                }
-                printf("   Object %10d - Size: %20ld - Type: %20s\n", i+1, labelObject->Size(), objectType);
-            } else {
-                if(objectType != NULL) {
-                    printf("   Object %10d - Size: %20ld - Type: %20s\n", i+1, labelObject->Size(), objectType);
-                }
-            }
-        }
+    /* Server mode */
+    if(serverSocket != NULL) {
+        int status = runServer(serverSocket, options, threads);
+        instrumentationFinish();
+        reportCache(cache);
+        return status;
     }
-    
-    // Shape Label Map filter
-    if(USE_SHAPELABELMAP) {
-        /* Apply an imagetoShapeLabelMap filter to separate objects */
-        BinaryImageToShapeLabelMapFilterType::Pointer binaryImageToShapeLabelMapFilter = getShapeLabelMap(invertIntensityFilter->GetOutput());
-        printf("> Results: \n");
-        
-        /* Loop over each region in the map */
-        for(unsigned int i = 0; i < binaryImageToShapeLabelMapFilter->GetOutput()->GetNumberOfLabelObjects(); i++) {
-            // Get the ith region
-            BinaryImageToShapeLabelMapFilterType::OutputImageType::LabelObjectType* labelObject = binaryImageToShapeLabelMapFilter->GetOutput()->GetNthLabelObject(i);
-            
-            // Check if the object size matches any coin
-            char* objectType;
-            long max_size = labelObject->GetBoundingBox().GetSize()[0] > labelObject->GetBoundingBox().GetSize()[1] ? labelObject->GetBoundingBox().GetSize()[0] : labelObject->GetBoundingBox().GetSize()[1];
-            double diff;
-            if(labelObject->GetBoundingBox().GetSize()[0] > labelObject->GetBoundingBox().GetSize()[1]) {
-                diff = (double) labelObject->GetBoundingBox().GetSize()[1] / (double) labelObject->GetBoundingBox().GetSize()[0];
-            } else {
-                diff = (double) labelObject->GetBoundingBox().GetSize()[0] / (double) labelObject->GetBoundingBox().GetSize()[1];
-            }
-            objectType = findCoinTypeLength(max_size);
-            if(diff < 0.8) {
-                continue;
-            } 
-            if(SHOW_ALL_OUTPUT) {
-                if(objectType == NULL) {
-                    objectType = (char*) "INDEFINIDO";
-                }
-                printf("   Object %10d - Length: %18ld - Type: %20s\n", i+1, max_size, objectType);
-            } else {
-                if(objectType != NULL) {
-                    printf("   Object %10d - Length: %18ld - Type: %20s\n", i+1, max_size, objectType);
 
-                    colorScan(imageColor, labelObject->GetBoundingBox().GetIndex()[0], labelObject->GetBoundingBox().GetIndex()[1], labelObject->GetBoundingBox().GetSize()[0], labelObject->GetBoundingBox().GetSize()[0]);
-
-                    for(unsigned int r = 0; r < labelObject->GetBoundingBox().GetSize()[0]; r++){
-                        for(unsigned int c = 0; c < labelObject->GetBoundingBox().GetSize()[1]; c++){
-                          ImageType::IndexType pixelIndex;
-                          pixelIndex[0] = labelObject->GetBoundingBox().GetIndex()[0] + r;
-                          pixelIndex[1] = labelObject->GetBoundingBox().GetIndex()[1] + c;
+    /* Video mode */
+    if(videoSource != NULL) {
+        std::string extension = itksys::SystemTools::LowerCase(itksys::SystemTools::GetFilenameLastExtension(videoSource));
+        video.format = extension == ".rgb" ? FRAME_RGB : (extension == ".yuv" ? FRAME_YUV420 : FRAME_FILES);
+        int status = runVideo(videoSource, options, video);
+        instrumentationFinish();
+        reportCache(cache);
+        return status;
+    }
 
-                          if(!strcmp(objectType, "1 REAL")) {
-                            image->SetPixel(pixelIndex, 255);
-                          } else {
-                            image->SetPixel(pixelIndex, 0);
-                          }
-                        }
-                    }
-                }
-            }
-        }
+    /* Batch mode */
+    if(batchSource != NULL) {
+        int status = runBatch(batchSource, options, threads);
+        instrumentationFinish();
+        reportCache(cache);
+        return status;
     }
-    
-    typedef  itk::ImageFileWriter< ImageType  > WriterType;
-    WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName("output.png");
-    writer->SetInput(image);
-    writer->Update();
 
-    writer->SetFileName("outputThresh.png");
-    writer->SetInput(closingFilter->GetOutput());
-    writer->Update();
+    if(path == NULL) {
+        printf("Usage: %s [--closing=fast|itk|compare] [--pyramid=FACTOR|--tiles=SIZE] [--low-memory] [--catalog=FILE] [--cache=DIRECTORY [--cache-size=MB]] [--stats[=FILE]] [--output=KINDS] [--compression=LEVEL] [FILE PATH]\n", argv[0]); 
+        printf("       %s [--closing=fast|itk|compare] [--pyramid=FACTOR|--tiles=SIZE] [--low-memory] [--catalog=FILE] [--cache=DIRECTORY [--cache-size=MB]] [--stats[=FILE]] --batch=[DIRECTORY|GLOB|LIST FILE] [--threads=N]\n", argv[0]); 
+        printf("       %s [--closing=fast|itk|compare] [--low-memory] [--catalog=FILE] [--cache=DIRECTORY [--cache-size=MB]] [--stats[=FILE]] --serve=SOCKET [--threads=N]\n", argv[0]); 
+        printf("       %s [--closing=fast|itk|compare] [--catalog=FILE] [--stats[=FILE]] --video=[DIRECTORY|GLOB|LIST FILE|RAW.rgb|RAW.yuv] [--frame-size=WxH] [--refresh=N]\n", argv[0]); 
+        printf("       %s [--closing=fast|itk|compare] --calibrate=DIRECTORY > CATALOG FILE\n", argv[0]); 
+        return 1;
+    }
 
-    typedef  itk::ImageFileWriter< ImageColorType  > WriterColorType;
-    WriterColorType::Pointer writerColor = WriterColorType::New();
-    writerColor->SetFileName("outputColor.png");
-    writerColor->SetInput(imageColor);
-    writerColor->Update();
+    /* Detection doesn't wait for the output images to be encoded */
+    if(options.outputImages != 0) {
+        outputWriterStart();
+    }
+    std::vector<CoinResult> results;
+    scanImage(path, options, results);
+    outputWriterFinish();
+    instrumentationFinish();
+    reportCache(cache);
 
     return EXIT_SUCCESS;
-}   
-  
-  
-
+}
@@ -0,0 +1,120 @@
+#ifndef COIN_SCANNER_H
+#define COIN_SCANNER_H
+
+/* INCLUDES */
+
+#include <string>
+#include <vector>
+
+/* OUTPUT IMAGES */
+#define OUTPUT_ANNOTATED    1   // output.png, gray image with the coin boxes filled
+#define OUTPUT_THRESHOLD    2   // outputThresh.png, closed threshold mask
+#define OUTPUT_COLOR        4   // outputColor.png, color input
+#define OUTPUT_ALL          7
+
+/* CLOSING ENGINES */
+#define CLOSING_ITK     0
+#define CLOSING_FAST    1
+#define CLOSING_COMPARE 2
+
+/* VIDEO FRAME FORMATS */
+#define FRAME_FILES     0   // Directory, glob pattern or list file of images
+#define FRAME_RGB       1   // Raw stream of interleaved 8 bit RGB frames (.rgb)
+#define FRAME_YUV420    2   // Raw stream of planar YUV 4:2:0 frames (.yuv)
+
+/* PIXEL FORMATS of caller owned buffers */
+#define PIXELS_GRAY     1   // 8 bit gray, one byte per pixel
+#define PIXELS_RGB      3   // Interleaved 8 bit RGB, three bytes per pixel
+
+class ResultCache;
+
+/* Detected coin */
+struct CoinResult {
+    unsigned int object;    // Label object number
+    long length;            // Largest bounding box side, in pixels
+    const char* type;       // Coin name (static string)
+    unsigned int x;         // Bounding box, in image coordinates
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+    unsigned long area;     // Pixel count
+    double roundness;       // About 1 for a disk
+    int r;                  // Color averages over the object
+    int g;
+    int b;
+};
+
+/* Scan options */
+struct ScanOptions {
+    int closingEngine;      // CLOSING_ITK, CLOSING_FAST or CLOSING_COMPARE
+    int outputImages;       // OUTPUT_* flags of the images to write, 0 for none
+    int pyramidFactor;      // Detect on the image shrunk by this factor, refine at full resolution (1 = off)
+    unsigned int tileSize;  // Segment and label in tiles of this size processed in parallel (0 = off)
+    int lowMemory;          // Threshold and closing in place, no invert pass, intermediates released early
+    ResultCache* cache;     // Results of images scanned before, looked up by content (NULL = off)
+};
+
+/* Video options */
+struct VideoOptions {
+    int format;             // FRAME_FILES, FRAME_RGB or FRAME_YUV420
+    unsigned int width;     // Frame size of raw streams
+    unsigned int height;
+    unsigned int refresh;   // Full scan every 'refresh' frames (0 = only on the first one)
+};
+
+/* @FUNCTIONS    */
+
+/* Progress lines are printed unless showProgress is 0 */
+extern int showProgress;
+void progress(const char* format, ...);
+
+/* Options of a plain scan: default closing engine, full resolution, no output images */
+ScanOptions defaultScanOptions();
+
+/* Scan an image file and append the detected coins to results. Throws itk::ExceptionObject
+   if the file can't be read. */
+void scanImage(const char* path, const ScanOptions& options, std::vector<CoinResult>& results);
+
+/* Scan a decoded image held by the caller and append the detected coins to results, as
+   scanImage does after decoding. 'pixels' points at the first pixel, in PIXELS_GRAY or
+   PIXELS_RGB 'format', and rows are 'stride' bytes apart. The buffer is wrapped without being
+   copied and is never written; it must stay valid during the call. Masks are made straight from
+   the rows, through their stride. Only a stride that isn't a whole number of RGB pixels is
+   copied, and a gray buffer that the pyramid scan or the annotated output needs as an image,
+   when it is padded or the options would write into it (low memory mode or the annotated
+   output). Gray buffers have no colors, their coins are matched as if black. The tile size is not used and the color output is not written. Throws
+   itk::ExceptionObject if the format or sizes are invalid. */
+void scanPixels(const unsigned char* pixels, unsigned int width, unsigned int height, long stride, int format, const ScanOptions& options, std::vector<CoinResult>& results);
+
+/* Scan every image of a directory, glob pattern or list file (one path per line) on
+   'threads' worker threads (0 = one per core). One JSON record per image is written to
+   stdout as soon as the image is done. Returns the process exit code. */
+int runBatch(const char* source, const ScanOptions& options, unsigned int threads);
+
+/* Result record of one image, as one JSON line: file and status, plus the time and coins if
+   'error' is NULL, else the error */
+std::string formatScanRecord(const std::string& file, double seconds, const std::vector<CoinResult>& results, const char* error);
+
+/* Expand a directory, glob pattern or list file into the files to scan */
+bool collectBatchFiles(const char* source, std::vector<std::string>& files);
+
+/* Check the file extension against the formats we read */
+bool isImageFile(const std::string& path);
+
+/* Serve scan requests on a Unix domain socket (see scanSocket.h) with 'threads' worker threads
+   (0 = one per core), each one with its own warm pipeline, until a SHUTDOWN request. Returns
+   the process exit code. */
+int runServer(const char* socketPath, const ScanOptions& options, unsigned int threads);
+
+/* Scan an ordered frame sequence from a fixed camera. After a full scan only the regions that
+   changed since they were last scanned are segmented again, and coins elsewhere are carried
+   over. One JSON record per frame, with the coins added and removed, is written to stdout.
+   Returns the process exit code. */
+int runVideo(const char* source, const ScanOptions& options, const VideoOptions& video);
+
+/* Derive a coin catalog from reference images, one subdirectory per coin named after it, and
+   write it to stdout. Each reference image must show one coin clear of the image border.
+   Returns the process exit code. */
+int runCalibration(const char* directory, const ScanOptions& options);
+
+#endif
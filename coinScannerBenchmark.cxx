@@ -0,0 +1,546 @@
+/* INCLUDES */
+
+#include "coinPipeline.h"
+#include "thresholdMask.h"
+#include <itksys/SystemTools.hxx>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/* BENCHMARK STAGES */
+#define STAGE_READ      0
+#define STAGE_MASK      1
+#define STAGE_CLOSING   2
+#define STAGE_REGIONS   3
+#define STAGE_CLASSIFY  4
+#define STAGE_WRITE     5
+#define STAGE_COUNT     6
+
+static const char* stageNames[STAGE_COUNT] = {
+    "read", "color threshold", "closing", "region stats", "classification", "write"
+};
+
+/* Separate pointwise passes the color threshold replaces, timed for comparison */
+#define PASS_GRAY       0
+#define PASS_THRESHOLD  1
+#define PASS_INVERT     2
+#define PASS_COUNT      3
+
+static const char* passNames[PASS_COUNT] = {
+    "gray", "threshold", "invert"
+};
+
+/* Coin appearance: the rim color and, for bimetallic coins, the center color */
+struct CoinAppearance {
+    const char* type;
+    unsigned char rim[3];
+    unsigned char center[3];
+};
+
+/* Appearance of the coins of the built in catalog. Other catalog coins are drawn plain, in a
+   silver clamped to their color ranges. */
+static const CoinAppearance coinAppearances[] = {
+    {"1 REAL",            {205, 175, 85},  {190, 190, 195}},
+    {"50 CENTAVOS",       {185, 185, 190}, {185, 185, 190}},
+    {"25 CENTAVOS",       {200, 170, 90},  {200, 170, 90}},
+    {"10 CENTAVOS",       {185, 185, 190}, {185, 185, 190}},
+    {"10 CENTAVOS GOLD",  {210, 180, 90},  {210, 180, 90}},
+    {"5 CENTAVOS",        {185, 185, 190}, {185, 185, 190}},
+    {"5 CENTAVOS BRONZE", {185, 115, 75},  {185, 115, 75}}
+};
+
+/* Coin drawn by the scene generator, from a catalog entry */
+struct CoinModel {
+    const char* type;           // Catalog name (static string)
+    long length;
+    unsigned char rim[3];
+    unsigned char center[3];
+};
+
+/* Ground truth of a generated coin */
+struct SyntheticCoin {
+    const CoinModel* model;
+    double x;
+    double y;
+};
+
+/* Scene generator settings */
+struct SceneOptions {
+    unsigned int coins;         // Coins per scene
+    unsigned int touching;      // Of those, coins placed touching another one
+    unsigned int clutter;       // Bright objects that are not coins
+    double noise;               // Standard deviation of the pixel noise
+    std::vector<CoinModel> models;  // Coins are drawn from these, a repeated one more often
+};
+
+/* Small deterministic generator (xorshift), so scenes are the same on every platform */
+struct Random {
+    unsigned int state;
+
+    unsigned int next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    double uniform() {
+        return (next() & 0xFFFFFF) / (double) 0x1000000;
+    }
+    double gaussian() {
+        double u = uniform() + 1e-12;
+        double v = uniform();
+        return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+    }
+};
+
+/* @FUNCTIONS    */
+
+static unsigned char clampPixel(double value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : (unsigned char) value);
+}
+
+/* Paint a filled disk */
+static void drawDisk(ImageColorType::Pointer image, double cx, double cy, double radius, const unsigned char* color) {
+    ImageColorType::SizeType size = image->GetLargestPossibleRegion().GetSize();
+    RGBPixelType* buffer = image->GetBufferPointer();
+    long y0 = std::max(0L, (long) floor(cy - radius));
+    long y1 = std::min((long) size[1] - 1, (long) ceil(cy + radius));
+    for(long y = y0; y <= y1; y++) {
+        double dy = y + 0.5 - cy;
+        double half = radius * radius - dy * dy;
+        if(half < 0) {
+            continue;
+        }
+        half = sqrt(half);
+        long x0 = std::max(0L, (long) ceil(cx - half - 0.5));
+        long x1 = std::min((long) size[0] - 1, (long) floor(cx + half - 0.5));
+        for(long x = x0; x <= x1; x++) {
+            RGBPixelType& pixel = buffer[y * size[0] + x];
+            pixel[0] = color[0];
+            pixel[1] = color[1];
+            pixel[2] = color[2];
+        }
+    }
+}
+
+/* Paint a filled rectangle */
+static void drawRectangle(ImageColorType::Pointer image, long x, long y, long width, long height, const unsigned char* color) {
+    ImageColorType::SizeType size = image->GetLargestPossibleRegion().GetSize();
+    RGBPixelType* buffer = image->GetBufferPointer();
+    for(long r = std::max(0L, y); r < std::min((long) size[1], y + height); r++) {
+        for(long c = std::max(0L, x); c < std::min((long) size[0], x + width); c++) {
+            buffer[r * size[0] + c][0] = color[0];
+            buffer[r * size[0] + c][1] = color[1];
+            buffer[r * size[0] + c][2] = color[2];
+        }
+    }
+}
+
+/* Generator model of a catalog coin */
+static CoinModel coinModel(const CoinSpec& spec) {
+    CoinModel model;
+    model.type = spec.name.c_str();
+    model.length = spec.length;
+    const unsigned char silver[3] = {185, 185, 190};
+    for(unsigned int c = 0; c < 3; c++) {
+        model.rim[c] = (unsigned char) std::min(std::max<int>(silver[c], spec.colorMin[c]), spec.colorMax[c]);
+        model.center[c] = model.rim[c];
+    }
+    for(unsigned int i = 0; i < sizeof(coinAppearances) / sizeof(coinAppearances[0]); i++) {
+        if(spec.name == coinAppearances[i].type) {
+            memcpy(model.rim, coinAppearances[i].rim, 3);
+            memcpy(model.center, coinAppearances[i].center, 3);
+        }
+    }
+    return model;
+}
+
+/* Models of the denominations to generate, comma separated catalog names, or of every catalog
+   coin with a length if 'denominations' is empty. False with 'error' set for an unknown name
+   or a coin without a length. */
+static bool selectModels(const std::string& denominations, std::vector<CoinModel>& models, std::string& error) {
+    const std::vector<CoinSpec>& entries = coinCatalog.GetEntries();
+    models.clear();
+    if(denominations.empty()) {
+        for(size_t i = 0; i < entries.size(); i++) {
+            if(entries[i].length > 0) {
+                models.push_back(coinModel(entries[i]));
+            }
+        }
+        if(models.empty()) {
+            error = "no catalog coin has a length";
+        }
+        return !models.empty();
+    }
+
+    std::vector<std::string> names;
+    itksys::SystemTools::Split(denominations.c_str(), names, ',');
+    for(size_t n = 0; n < names.size(); n++) {
+        std::string name = itksys::SystemTools::TrimWhitespace(names[n]);
+        size_t i = 0;
+        while(i < entries.size() && entries[i].name != name) {
+            i++;
+        }
+        if(i == entries.size()) {
+            error = "unknown denomination: " + name;
+            return false;
+        }
+        if(entries[i].length <= 0) {
+            error = "no length in the catalog: " + name;
+            return false;
+        }
+        models.push_back(coinModel(entries[i]));
+    }
+    return true;
+}
+
+/* Generate a scene: coins of the selected denominations, at their catalog length, on a dark, noisy cloth, some of them touching,
+   plus bright clutter (specks, bars and blocks) that must not be classified as coins */
+static ImageColorType::Pointer generateScene(unsigned int width, unsigned int height, const SceneOptions& scene, Random& random, std::vector<SyntheticCoin>& truth) {
+    ImageColorType::Pointer image = ImageColorType::New();
+    ImageColorType::SizeType size;
+    size[0] = width;
+    size[1] = height;
+    image->SetRegions(size);
+    image->Allocate();
+
+    unsigned char cloth[3] = {45, 50, 55};
+    drawRectangle(image, 0, 0, width, height, cloth);
+
+    // Coins: random positions away from the other coins, or touching the previous one
+    truth.clear();
+    for(unsigned int i = 0; i < scene.coins; i++) {
+        const CoinModel* model = &scene.models[random.next() % scene.models.size()];
+        double radius = model->length / 2.0;
+        bool touch = i > 0 && i <= scene.touching;
+        for(unsigned int attempt = 0; attempt < 1000; attempt++) {
+            double x;
+            double y;
+            if(touch) {
+                const SyntheticCoin& other = truth.back();
+                double angle = random.uniform() * 2.0 * M_PI;
+                double distance = radius + other.model->length / 2.0;
+                x = other.x + distance * cos(angle);
+                y = other.y + distance * sin(angle);
+            } else {
+                x = radius + 40 + random.uniform() * (width - 2 * radius - 80);
+                y = radius + 40 + random.uniform() * (height - 2 * radius - 80);
+            }
+            bool free = x - radius >= 40 && y - radius >= 40 && x + radius <= width - 40 && y + radius <= height - 40;
+            for(size_t j = 0; j < truth.size() && free; j++) {
+                double gap = touch && j + 1 == truth.size() ? 0 : 80;
+                double dx = truth[j].x - x;
+                double dy = truth[j].y - y;
+                free = sqrt(dx * dx + dy * dy) >= radius + truth[j].model->length / 2.0 + gap - 0.5;
+            }
+            if(free) {
+                SyntheticCoin coin;
+                coin.model = model;
+                coin.x = x;
+                coin.y = y;
+                truth.push_back(coin);
+                drawDisk(image, x, y, radius, model->rim);
+                if(memcmp(model->rim, model->center, 3)) {
+                    drawDisk(image, x, y, radius * 0.72, model->center);
+                }
+                break;
+            }
+        }
+    }
+
+    // Clutter, kept clear of the coins so it doesn't change their size
+    unsigned char bright[3] = {220, 220, 215};
+    for(unsigned int i = 0; i < scene.clutter; i++) {
+        long clutterWidth;
+        long clutterHeight;
+        switch(i % 3) {
+            case 0:
+                clutterWidth = 2 + random.next() % 8;
+                clutterHeight = 2 + random.next() % 8;
+                break;
+            case 1:
+                clutterWidth = 150 + random.next() % 100;
+                clutterHeight = 40 + random.next() % 30;
+                break;
+            default:
+                clutterWidth = 120 + random.next() % 40;
+                clutterHeight = 120 + random.next() % 40;
+                break;
+        }
+        for(unsigned int attempt = 0; attempt < 100; attempt++) {
+            long x = random.next() % width;
+            long y = random.next() % height;
+            bool free = true;
+            for(size_t j = 0; j < truth.size() && free; j++) {
+                double reach = truth[j].model->length / 2.0 + 80;
+                free = truth[j].x + reach < x || truth[j].x - reach > x + clutterWidth || truth[j].y + reach < y || truth[j].y - reach > y + clutterHeight;
+            }
+            if(free) {
+                drawRectangle(image, x, y, clutterWidth, clutterHeight, bright);
+                break;
+            }
+        }
+    }
+
+    // Noise
+    if(scene.noise > 0) {
+        RGBPixelType* buffer = image->GetBufferPointer();
+        size_t pixels = (size_t) width * height;
+        for(size_t i = 0; i < pixels; i++) {
+            double n = random.gaussian() * scene.noise;
+            buffer[i][0] = clampPixel(buffer[i][0] + n);
+            buffer[i][1] = clampPixel(buffer[i][1] + n);
+            buffer[i][2] = clampPixel(buffer[i][2] + n);
+        }
+    }
+
+    return image;
+}
+
+/* Match detections to the ground truth by center distance */
+static void scoreScene(const std::vector<SyntheticCoin>& truth, const std::vector<CoinResult>& results, unsigned int* correct, unsigned int* wrongType, unsigned int* missed, unsigned int* falsePositives) {
+    std::vector<bool> matched(truth.size(), false);
+    for(size_t i = 0; i < results.size(); i++) {
+        double x = results[i].x + results[i].width / 2.0;
+        double y = results[i].y + results[i].height / 2.0;
+        long best = -1;
+        double bestDistance = 0;
+        for(size_t j = 0; j < truth.size(); j++) {
+            double distance = sqrt((truth[j].x - x) * (truth[j].x - x) + (truth[j].y - y) * (truth[j].y - y));
+            if(!matched[j] && distance < truth[j].model->length / 4.0 && (best < 0 || distance < bestDistance)) {
+                best = j;
+                bestDistance = distance;
+            }
+        }
+        if(best < 0) {
+            (*falsePositives)++;
+            continue;
+        }
+        matched[best] = true;
+        if(!strcmp(truth[best].model->type, results[i].type)) {
+            (*correct)++;
+        } else {
+            (*wrongType)++;
+        }
+    }
+    for(size_t j = 0; j < truth.size(); j++) {
+        if(!matched[j]) {
+            (*missed)++;
+        }
+    }
+}
+
+/* Run every stage of the pipeline on a scene file, timing each one separately. The separate
+   gray, threshold and invert passes are timed too, and the pixels where their threshold mask
+   differs from the color threshold are counted. The output images are written to 'outputPrefix'
+   followed by ".png", "Thresh.png" and "Color.png". */
+static void benchmarkScene(const std::string& path, const std::string& outputPrefix, int closingEngine, double* seconds, double* passSeconds, unsigned long* differences, std::vector<CoinResult>& results) {
+    itk::TimeProbe probes[STAGE_COUNT];
+    itk::TimeProbe passProbes[PASS_COUNT];
+
+    probes[STAGE_READ].Start();
+    ReaderColorType::Pointer reader = readColorFromFile((char*) path.c_str());
+    ImageColorType::Pointer imageColor = reader->GetOutput();
+    probes[STAGE_READ].Stop();
+
+    probes[STAGE_MASK].Start();
+    ImageType::Pointer thresholdImage = applyColorThreshold(imageColor, THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0);
+    probes[STAGE_MASK].Stop();
+
+    passProbes[PASS_GRAY].Start();
+    ImageType::Pointer image = convertToGray(imageColor);
+    passProbes[PASS_GRAY].Stop();
+
+    passProbes[PASS_THRESHOLD].Start();
+    BinaryThresholdImageFilterType::Pointer thresholdFilter = applyThresholdFilter(image, THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0);
+    passProbes[PASS_THRESHOLD].Stop();
+
+    const ImageType::PixelType* fused = thresholdImage->GetBufferPointer();
+    const ImageType::PixelType* separate = thresholdFilter->GetOutput()->GetBufferPointer();
+    unsigned long pixels = thresholdImage->GetBufferedRegion().GetNumberOfPixels();
+    for(unsigned long i = 0; i < pixels; i++) {
+        *differences += fused[i] != separate[i];
+    }
+    thresholdFilter = NULL;
+
+    probes[STAGE_CLOSING].Start();
+    ImageType::Pointer closedImage = applyClosing(thresholdImage, CLOSING_RADIUS, closingEngine);
+    probes[STAGE_CLOSING].Stop();
+
+    passProbes[PASS_INVERT].Start();
+    invertImage(closedImage, 255);
+    passProbes[PASS_INVERT].Stop();
+
+    // Coins are the background of the closed image
+    probes[STAGE_REGIONS].Start();
+    std::vector<RegionStats> regions;
+    std::vector<unsigned int> numbers;
+    getCoinRegions(closedImage, imageColor, imageColor->GetBufferedRegion().GetIndex(), 0, regions, numbers);
+    probes[STAGE_REGIONS].Stop();
+
+    probes[STAGE_CLASSIFY].Start();
+    for(size_t i = 0; i < regions.size(); i++) {
+        classifyRegion(regions[i], numbers[i], results);
+    }
+    probes[STAGE_CLASSIFY].Stop();
+
+    probes[STAGE_WRITE].Start();
+    annotateResults(image, results);
+    typedef itk::ImageFileWriter<ImageType> WriterType;
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(outputPrefix + ".png");
+    writer->SetInput(image);
+    writer->Update();
+    writer->SetFileName(outputPrefix + "Thresh.png");
+    writer->SetInput(closedImage);
+    writer->Update();
+    typedef itk::ImageFileWriter<ImageColorType> WriterColorType;
+    WriterColorType::Pointer writerColor = WriterColorType::New();
+    writerColor->SetFileName(outputPrefix + "Color.png");
+    writerColor->SetInput(imageColor);
+    writerColor->Update();
+    probes[STAGE_WRITE].Stop();
+
+    for(unsigned int s = 0; s < STAGE_COUNT; s++) {
+        seconds[s] += probes[s].GetTotal();
+    }
+    for(unsigned int p = 0; p < PASS_COUNT; p++) {
+        passSeconds[p] += passProbes[p].GetTotal();
+    }
+}
+
+/* @MAIN */
+int main(int argc, char *argv[]){
+
+    /* Check arguments */
+    std::string sizes = "2000x1500,4000x3000";
+    unsigned int scenes = 3;
+    unsigned int seed = 1;
+    int closingEngine = USE_FAST_CLOSING ? CLOSING_FAST : CLOSING_ITK;
+    std::string denominations;
+    const char* catalogPath = NULL;
+    bool keepImages = false;
+    SceneOptions scene;
+    scene.coins = 12;
+    scene.touching = 2;
+    scene.clutter = 30;
+    scene.noise = 8;
+    for(int i = 1; i < argc; i++) {
+        if(!strncmp(argv[i], "--sizes=", 8)) {
+            sizes = argv[i] + 8;
+        } else if(!strncmp(argv[i], "--scenes=", 9)) {
+            scenes = atoi(argv[i] + 9);
+        } else if(!strncmp(argv[i], "--coins=", 8)) {
+            scene.coins = atoi(argv[i] + 8);
+        } else if(!strncmp(argv[i], "--touching=", 11)) {
+            scene.touching = atoi(argv[i] + 11);
+        } else if(!strncmp(argv[i], "--clutter=", 10)) {
+            scene.clutter = atoi(argv[i] + 10);
+        } else if(!strncmp(argv[i], "--noise=", 8)) {
+            scene.noise = atof(argv[i] + 8);
+        } else if(!strncmp(argv[i], "--denominations=", 16)) {
+            denominations = argv[i] + 16;
+        } else if(!strncmp(argv[i], "--catalog=", 10)) {
+            catalogPath = argv[i] + 10;
+        } else if(!strcmp(argv[i], "--keep-images")) {
+            keepImages = true;
+        } else if(!strncmp(argv[i], "--seed=", 7)) {
+            seed = atoi(argv[i] + 7);
+        } else if(!strcmp(argv[i], "--closing=itk")) {
+            closingEngine = CLOSING_ITK;
+        } else if(!strcmp(argv[i], "--closing=fast")) {
+            closingEngine = CLOSING_FAST;
+        } else {
+            printf("Usage: %s [--sizes=WxH,...] [--scenes=N] [--coins=N] [--touching=N] [--clutter=N] [--noise=SIGMA] [--denominations=NAME,...] [--catalog=FILE] [--seed=N] [--closing=fast|itk] [--keep-images]\n", argv[0]);
+            return 1;
+        }
+    }
+    showProgress = 0;
+
+    /* Coins of the scenes, from the catalog */
+    std::string error;
+    if(catalogPath != NULL && !coinCatalog.Load(catalogPath, error)) {
+        printf("Could not load coin catalog: %s\n", error.c_str());
+        return 1;
+    }
+    if(!selectModels(denominations, scene.models, error)) {
+        printf("Invalid denominations: %s\n", error.c_str());
+        return 1;
+    }
+
+    Random random;
+    random.state = seed ? seed : 1;
+    std::vector<std::string> files;
+
+    std::vector<std::string> sizeList;
+    itksys::SystemTools::Split(sizes.c_str(), sizeList, ',');
+    for(size_t s = 0; s < sizeList.size(); s++) {
+        unsigned int width;
+        unsigned int height;
+        if(sscanf(sizeList[s].c_str(), "%ux%u", &width, &height) != 2 || width < 600 || height < 600) {
+            printf("Invalid size: %s (minimum 600x600)\n", sizeList[s].c_str());
+            return 1;
+        }
+
+        double seconds[STAGE_COUNT] = {0};
+        double passSeconds[PASS_COUNT] = {0};
+        unsigned long differences = 0;
+        unsigned int coins = 0;
+        unsigned int correct = 0;
+        unsigned int wrongType = 0;
+        unsigned int missed = 0;
+        unsigned int falsePositives = 0;
+        for(unsigned int n = 0; n < scenes; n++) {
+            // Every scene and output image has its own file, kept with --keep-images
+            char name[64];
+            snprintf(name, sizeof(name), "benchmark-%ux%u-%u", width, height, n + 1);
+            std::string scenePath = std::string(name) + "-scene.png";
+            std::string outputPrefix = std::string(name) + "-output";
+            files.push_back(scenePath);
+            files.push_back(outputPrefix + ".png");
+            files.push_back(outputPrefix + "Thresh.png");
+            files.push_back(outputPrefix + "Color.png");
+
+            std::vector<SyntheticCoin> truth;
+            ImageColorType::Pointer sceneImage = generateScene(width, height, scene, random, truth);
+            typedef itk::ImageFileWriter<ImageColorType> WriterColorType;
+            WriterColorType::Pointer writer = WriterColorType::New();
+            writer->SetFileName(scenePath);
+            writer->SetInput(sceneImage);
+            writer->Update();
+
+            std::vector<CoinResult> results;
+            benchmarkScene(scenePath, outputPrefix, closingEngine, seconds, passSeconds, &differences, results);
+            coins += truth.size();
+            scoreScene(truth, results, &correct, &wrongType, &missed, &falsePositives);
+        }
+
+        double megapixels = (double) width * height * scenes / 1e6;
+        double total = 0;
+        printf("> Scenes: %ux%u - %u scenes - %u coins\n", width, height, scenes, coins);
+        printf("   %-16s %12s %12s\n", "Stage", "Seconds", "MP/s");
+        for(unsigned int i = 0; i < STAGE_COUNT; i++) {
+            total += seconds[i];
+            printf("   %-16s %12.3f %12.2f\n", stageNames[i], seconds[i], seconds[i] > 0 ? megapixels / seconds[i] : 0.0);
+        }
+        printf("   %-16s %12.3f %12.2f\n", "total", total, total > 0 ? megapixels / total : 0.0);
+        double separate = 0;
+        printf("   Separate passes replaced by the %s color threshold:\n", thresholdMaskKernel());
+        for(unsigned int i = 0; i < PASS_COUNT; i++) {
+            separate += passSeconds[i];
+            printf("   %-16s %12.3f %12.2f\n", passNames[i], passSeconds[i], passSeconds[i] > 0 ? megapixels / passSeconds[i] : 0.0);
+        }
+        printf("   Speedup: %.1fx - %lu different pixels\n", seconds[STAGE_MASK] > 0 ? separate / seconds[STAGE_MASK] : 0.0, differences);
+        printf("   Accuracy: %u/%u correct - %u wrong type - %u missed - %u false positives\n", correct, coins, wrongType, missed, falsePositives);
+    }
+
+    for(size_t i = 0; i < files.size() && !keepImages; i++) {
+        itksys::SystemTools::RemoveFile(files[i].c_str());
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/* INCLUDES */
+
+#include "scanSocket.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkTimeProbe.h"
+#include <itksys/SystemTools.hxx>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Load generator options and results */
+struct LoadState {
+    const char* socketPath;
+    std::vector<std::string> files;
+    std::vector<std::string> contents;      // Encoded images sent with DATA requests, empty for SCAN
+    unsigned int requests;
+    std::vector<double> latencies;          // Seconds of each request, -1 if it got no answer
+    unsigned int failed;
+    std::string error;                      // First connection failure
+    itk::SimpleFastMutexLock lock;          // Protects failed and error
+};
+
+/* @FUNCTIONS    */
+
+/* Latency at quantile q of the sorted latencies */
+static double percentile(const std::vector<double>& sorted, double q) {
+    if(sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t) (q * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+/* Objects of an answer, without the fields that change from one request to the next */
+static std::string answerObjects(const std::string& answer) {
+    size_t objects = answer.find("\"objects\": ");
+    return objects == std::string::npos ? std::string() : answer.substr(objects);
+}
+
+/* Send the bytes of every image on one connection, one after the other, then their paths, and
+   check that each DATA answer has the coins of its own image. Images with the same coins
+   can't tell a stale answer from a right one, so they are an error too. */
+static bool checkData(const LoadState& state, std::string& error) {
+    int connection = connectUnixSocket(state.socketPath, error);
+    if(connection < 0) {
+        return false;
+    }
+    SocketReader reader(connection);
+    std::vector<std::string> dataAnswers;
+    std::vector<std::string> scanAnswers;
+    std::string answer;
+    for(size_t i = 0; i < 2 * state.files.size(); i++) {
+        size_t file = i % state.files.size();
+        std::string request;
+        if(i < state.files.size()) {
+            char header[128];
+            snprintf(header, sizeof(header), "DATA %s %lu\n", itksys::SystemTools::GetFilenameLastExtension(state.files[file]).c_str(), (unsigned long) state.contents[file].size());
+            request = header + state.contents[file];
+        } else {
+            request = "SCAN " + state.files[file] + "\n";
+        }
+        if(!writeAll(connection, request.data(), request.size()) || !reader.ReadLine(answer)) {
+            error = "no answer for " + state.files[file];
+            close(connection);
+            return false;
+        }
+        if(answer.find("\"status\": \"ok\"") == std::string::npos) {
+            error = "failed request for " + state.files[file] + ": " + answer;
+            close(connection);
+            return false;
+        }
+        (i < state.files.size() ? dataAnswers : scanAnswers).push_back(answerObjects(answer));
+    }
+    close(connection);
+
+    for(size_t i = 0; i < state.files.size(); i++) {
+        if(dataAnswers[i] != scanAnswers[i]) {
+            error = "the DATA answer of " + state.files[i] + " is not the one of its path";
+            return false;
+        }
+        if(i > 0 && dataAnswers[i] == dataAnswers[i - 1]) {
+            error = state.files[i - 1] + " and " + state.files[i] + " have the same coins";
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Connection thread: send its share of the requests one after the other */
+static ITK_THREAD_RETURN_TYPE loadWorker(void* arg) {
+    itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct*) arg;
+    LoadState* state = (LoadState*) info->UserData;
+
+    std::string error;
+    int connection = connectUnixSocket(state->socketPath, error);
+    if(connection < 0) {
+        state->lock.Lock();
+        state->error = error;
+        state->lock.Unlock();
+        return ITK_THREAD_RETURN_VALUE;
+    }
+
+    SocketReader reader(connection);
+    std::string answer;
+    unsigned int failed = 0;
+    for(unsigned int i = info->ThreadID; i < state->requests; i += info->NumberOfThreads) {
+        size_t file = i % state->files.size();
+        std::string request;
+        if(state->contents.empty()) {
+            request = "SCAN " + state->files[file] + "\n";
+        } else {
+            char header[128];
+            snprintf(header, sizeof(header), "DATA %s %lu\n", itksys::SystemTools::GetFilenameLastExtension(state->files[file]).c_str(), (unsigned long) state->contents[file].size());
+            request = header + state->contents[file];
+        }
+
+        itk::TimeProbe time;
+        time.Start();
+        if(!writeAll(connection, request.data(), request.size()) || !reader.ReadLine(answer)) {
+            failed += (state->requests - i + info->NumberOfThreads - 1) / info->NumberOfThreads;
+            break;
+        }
+        time.Stop();
+        state->latencies[i] = time.GetTotal();
+        if(answer.find("\"status\": \"ok\"") == std::string::npos) {
+            failed++;
+        }
+    }
+    close(connection);
+
+    state->lock.Lock();
+    state->failed += failed;
+    state->lock.Unlock();
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+/* @MAIN */
+int main(int argc, char *argv[]){
+
+    /* Check arguments */
+    LoadState state;
+    state.socketPath = NULL;
+    state.requests = 100;
+    state.failed = 0;
+    unsigned int connections = 4;
+    bool sendData = false;
+    bool stopServer = false;
+    bool check = false;
+    for(int i = 1; i < argc; i++) {
+        if(!strncmp(argv[i], "--socket=", 9)) {
+            state.socketPath = argv[i] + 9;
+        } else if(!strncmp(argv[i], "--requests=", 11)) {
+            state.requests = atoi(argv[i] + 11);
+        } else if(!strncmp(argv[i], "--connections=", 14)) {
+            connections = atoi(argv[i] + 14);
+        } else if(!strcmp(argv[i], "--data")) {
+            sendData = true;
+        } else if(!strcmp(argv[i], "--check")) {
+            check = true;
+        } else if(!strcmp(argv[i], "--shutdown")) {
+            stopServer = true;
+        } else if(!strncmp(argv[i], "--", 2)) {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        } else {
+            state.files.push_back(argv[i]);
+        }
+    }
+    if(state.socketPath == NULL || (state.files.empty() && !stopServer) || (check && state.files.size() < 2) || connections == 0) {
+        printf("Usage: %s --socket=PATH [--requests=N] [--connections=N] [--data] [--check] [--shutdown] IMAGE...\n", argv[0]);
+        return 1;
+    }
+
+    /* Images sent as bytes are read once, outside of the measured time */
+    if(sendData || check) {
+        for(size_t i = 0; i < state.files.size(); i++) {
+            std::ifstream file(state.files[i].c_str(), std::ios::binary);
+            if(!file) {
+                printf("Could not read %s\n", state.files[i].c_str());
+                return 1;
+            }
+            state.contents.push_back(std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+        }
+    }
+
+    /* Answers to DATA requests are checked against the ones of the same images by path */
+    if(check) {
+        std::string error;
+        if(!checkData(state, error)) {
+            printf("Check failed: %s\n", error.c_str());
+            return 1;
+        }
+        printf("> Check: %lu images - DATA answers match their paths\n", (unsigned long) state.files.size());
+        if(!sendData) {
+            state.contents.clear();
+        }
+    }
+
+    /* Requests are spread over the connections, each one waits for an answer before the next */
+    if(!state.files.empty() && state.requests > 0) {
+        connections = std::min(connections, state.requests);
+        state.latencies.assign(state.requests, -1);
+        itk::TimeProbe time;
+        time.Start();
+        itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+        threader->SetNumberOfThreads(connections);
+        threader->SetSingleMethod(loadWorker, &state);
+        threader->SingleMethodExecute();
+        time.Stop();
+        if(!state.error.empty()) {
+            printf("Could not connect: %s\n", state.error.c_str());
+            return 1;
+        }
+
+        std::vector<double> sorted;
+        for(size_t i = 0; i < state.latencies.size(); i++) {
+            if(state.latencies[i] >= 0) {
+                sorted.push_back(state.latencies[i]);
+            }
+        }
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0;
+        for(size_t i = 0; i < sorted.size(); i++) {
+            total += sorted[i];
+        }
+        printf("> Requests: %u - %u failed - %u connections - %.3fs - %.1f requests/s\n", state.requests, state.failed, connections,
+            time.GetTotal(), time.GetTotal() > 0 ? sorted.size() / time.GetTotal() : 0.0);
+        printf("> Latency (ms): mean %.2f - p50 %.2f - p90 %.2f - p99 %.2f - max %.2f\n", sorted.empty() ? 0.0 : 1000 * total / sorted.size(),
+            1000 * percentile(sorted, 0.5), 1000 * percentile(sorted, 0.9), 1000 * percentile(sorted, 0.99), sorted.empty() ? 0.0 : 1000 * sorted.back());
+    }
+
+    /* Stop the server */
+    if(stopServer) {
+        std::string error;
+        int connection = connectUnixSocket(state.socketPath, error);
+        if(connection < 0) {
+            printf("Could not connect: %s\n", error.c_str());
+            return 1;
+        }
+        writeAll(connection, "SHUTDOWN\n", 9);
+        SocketReader reader(connection);
+        std::string answer;
+        reader.ReadLine(answer);
+        close(connection);
+    }
+
+    return state.failed > 0 ? 1 : 0;
+}
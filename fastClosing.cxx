@@ -0,0 +1,113 @@
+/* INCLUDES */
+
+#include "fastClosing.h"
+#include <algorithm>
+#include <vector>
+#include <string.h>
+
+/* @FUNCTIONS    */
+
+/* Horizontal running count over a window of 'radius' pixels on each side. Sets out[x] to 1
+   when the count matches the condition: any pixel set (dilate) or all pixels set (erode). */
+static void lineWindow(const unsigned char* in, unsigned char* out, int length, int radius, bool dilate) {
+    int window = 2 * radius + 1;
+    int count = 0;
+    for(int x = 0; x < radius && x < length; x++) {
+        count += in[x];
+    }
+    for(int x = 0; x < length; x++) {
+        if(x + radius < length) {
+            count += in[x + radius];
+        }
+        if(x - radius - 1 >= 0) {
+            count -= in[x - radius - 1];
+        }
+        out[x] = dilate ? (count > 0) : (count == window);
+    }
+}
+
+void fastBinaryClosing(const unsigned char* src, unsigned char* dst, int width, int height, int radius, unsigned char foreground) {
+    if(width <= 0 || height <= 0) {
+        return;
+    }
+    if(radius <= 0) {
+        if(dst != src) {
+            memcpy(dst, src, (size_t) width * height);
+        }
+        return;
+    }
+
+    // The dilation can reach 'radius' pixels past the image, and the erosion of an image
+    // pixel reads that far, so rows are padded with 'radius' zero pixels on each side and the
+    // image with 'radius' zero rows above and below. Rows stream through two rings: padded
+    // row p + radius is read when dilated row p is made, and output row p - 2 * radius is
+    // eroded from dilated rows p - 2 * radius to p, so only 2 * radius + 2 rows of each are
+    // kept. Input row y is read before output row y is written, which allows src == dst.
+    int paddedWidth = width + 2 * radius;
+    int paddedHeight = height + 2 * radius;
+    int ringRows = 2 * radius + 2;
+    int window = 2 * radius + 1;
+    std::vector<unsigned char> padded((size_t) ringRows * paddedWidth, 0);
+    std::vector<unsigned char> dilated((size_t) ringRows * paddedWidth, 0);
+    std::vector<unsigned char> horizontal(paddedWidth, 0);
+    std::vector<int> dilateCount(paddedWidth, 0);
+    std::vector<int> erodeCount(paddedWidth, 0);
+
+    for(int p = 0; p < paddedHeight; p++) {
+        // Vertical dilation window: padded rows p - radius to p + radius, only image rows
+        // can contain foreground
+        int incoming = p + radius;
+        if(incoming >= radius && incoming < radius + height) {
+            const unsigned char* in = src + (size_t) (incoming - radius) * width;
+            unsigned char* row = &padded[(size_t) (incoming % ringRows) * paddedWidth];
+            for(int x = 0; x < width; x++) {
+                row[x + radius] = (in[x] == foreground);
+            }
+            for(int x = radius; x < radius + width; x++) {
+                dilateCount[x] += row[x];
+            }
+        }
+        int outgoing = p - radius - 1;
+        if(outgoing >= radius && outgoing < radius + height) {
+            const unsigned char* row = &padded[(size_t) (outgoing % ringRows) * paddedWidth];
+            for(int x = radius; x < radius + width; x++) {
+                dilateCount[x] -= row[x];
+            }
+        }
+
+        // Dilation: union of the horizontal and the vertical line dilations
+        unsigned char* dilatedRow = &dilated[(size_t) (p % ringRows) * paddedWidth];
+        if(p >= radius && p < radius + height) {
+            lineWindow(&padded[(size_t) (p % ringRows) * paddedWidth], dilatedRow, paddedWidth, radius, true);
+        } else {
+            std::fill(dilatedRow, dilatedRow + paddedWidth, 0);
+        }
+        for(int x = radius; x < radius + width; x++) {
+            dilatedRow[x] |= (dilateCount[x] > 0);
+        }
+
+        // Erosion: intersection of the horizontal and the vertical line erosions, only needed
+        // for the image pixels
+        for(int x = radius; x < radius + width; x++) {
+            erodeCount[x] += dilatedRow[x];
+        }
+        int e = p - radius;
+        if(e < radius || e >= radius + height) {
+            continue;
+        }
+        lineWindow(&dilated[(size_t) (e % ringRows) * paddedWidth], &horizontal[0], paddedWidth, radius, false);
+        const unsigned char* in = src + (size_t) (e - radius) * width;
+        unsigned char* out = dst + (size_t) (e - radius) * width;
+        for(int x = radius; x < radius + width; x++) {
+            if(horizontal[x] && erodeCount[x] == window) {
+                out[x - radius] = foreground;
+            } else if(out != in) {
+                out[x - radius] = in[x - radius];
+            }
+        }
+        const unsigned char* remove = &dilated[(size_t) ((e - radius) % ringRows) * paddedWidth];
+        for(int x = radius; x < radius + width; x++) {
+            erodeCount[x] -= remove[x];
+        }
+    }
+}
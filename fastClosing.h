@@ -0,0 +1,19 @@
+#ifndef FAST_CLOSING_H
+#define FAST_CLOSING_H
+
+/* Binary morphological closing with a cross shaped structuring element (same shape as
+   itk::BinaryCrossStructuringElement). Pixels equal to 'foreground' are the object; pixels
+   outside the image are treated as background, which is what ITK's closing filter does with
+   SafeBorder enabled. Closed pixels are set to 'foreground', every other pixel keeps its
+   input value, so the output is identical to itk::BinaryMorphologicalClosingImageFilter.
+
+   The cross is the union of a horizontal and a vertical line, so the dilation is the union
+   of two 1D dilations and the erosion the intersection of two 1D erosions. Each 1D pass is
+   a running window count, which makes the cost per pixel independent of the radius.
+
+   Rows are streamed, so besides the images only 2 * (2 * radius + 2) padded rows are kept.
+   'src' and 'dst' may point to the same buffer. Both are 'width' x 'height' with rows of
+   'width' bytes. */
+void fastBinaryClosing(const unsigned char* src, unsigned char* dst, int width, int height, int radius, unsigned char foreground);
+
+#endif
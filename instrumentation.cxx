@@ -0,0 +1,265 @@
+/* INCLUDES */
+
+#include "instrumentation.h"
+#include "coinScanner.h"
+#include "itkSimpleFastMutexLock.h"
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* Totals of one stage over every recorded image */
+struct StageTotal {
+    unsigned long count;
+    double seconds;
+    double maxSeconds;
+    long maxMemoryDelta;
+    long maxPeakMemory;
+    double pixels;
+    double objects;
+};
+
+bool instrumentationEnabled = false;
+
+static FILE* statsFile = NULL;
+static bool statsCSV = false;
+static itk::SimpleFastMutexLock statsLock;                 // Protects the file and the totals
+static std::vector<std::string> stageOrder;
+static std::map<std::string, StageTotal> stageTotals;
+static unsigned long imageCount = 0;
+static __thread ImageRecord* currentRecord = NULL;
+static itk::SimpleFastMutexLock peakLock;                  // Protects resetPeak
+static long resetPeak = 0;                                 // Highest mark the stage resets cleared
+
+/* @FUNCTIONS    */
+
+static double wallTime() {
+    struct timeval time;
+    gettimeofday(&time, NULL);
+    return time.tv_sec + time.tv_usec * 1e-6;
+}
+
+long peakResidentMemory() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    peakLock.Lock();
+    long peak = std::max<long>(usage.ru_maxrss, resetPeak);
+    peakLock.Unlock();
+    return peak;
+}
+
+/* High-water mark of the resident set size since the last reset, in KB (0 where
+   /proc/self/status doesn't have it) */
+static long highWaterMark() {
+    FILE* status = fopen("/proc/self/status", "r");
+    if(status == NULL) {
+        return 0;
+    }
+    char line[256];
+    long mark = 0;
+    while(fgets(line, sizeof(line), status) != NULL) {
+        if(sscanf(line, "VmHWM: %ld", &mark) == 1) {
+            break;
+        }
+    }
+    fclose(status);
+    return mark;
+}
+
+/* Reset the high-water mark to the current resident set size, keeping the cleared one for
+   peakResidentMemory(). False where the kernel can't. */
+static bool resetHighWaterMark() {
+    long mark = highWaterMark();
+    peakLock.Lock();
+    resetPeak = std::max(resetPeak, mark);
+    peakLock.Unlock();
+    FILE* clearRefs = fopen("/proc/self/clear_refs", "w");
+    if(clearRefs == NULL) {
+        return false;
+    }
+    bool reset = fputs("5", clearRefs) >= 0;
+    return fclose(clearRefs) == 0 && reset;
+}
+
+long currentResidentMemory() {
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if(statm == NULL) {
+        return 0;
+    }
+    long pages = 0;
+    long resident = 0;
+    if(fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for(size_t i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+        if(c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if(c < 0x20) {
+            char code[8];
+            sprintf(code, "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+bool instrumentationStart(const char* path) {
+    if(path != NULL && path[0] != '\0') {
+        statsFile = fopen(path, "a");
+        if(statsFile == NULL) {
+            return false;
+        }
+        size_t length = strlen(path);
+        statsCSV = length >= 4 && !strcmp(path + length - 4, ".csv");
+        fseek(statsFile, 0, SEEK_END);
+        if(statsCSV && ftell(statsFile) == 0) {
+            fprintf(statsFile, "file,stage,seconds,memory_delta_kb,peak_kb,pixels,objects\n");
+        }
+    }
+    instrumentationEnabled = true;
+    return true;
+}
+
+void instrumentationFinish() {
+    if(!instrumentationEnabled) {
+        return;
+    }
+    instrumentationEnabled = false;
+    if(statsFile != NULL) {
+        fclose(statsFile);
+        statsFile = NULL;
+    }
+
+    fprintf(stderr, "> Stage totals over %lu images:\n", imageCount);
+    fprintf(stderr, "   %-24s %8s %12s %12s %12s %14s %14s %10s\n", "Stage", "Runs", "Seconds", "Max", "MP/s", "Max RSS delta", "Max peak", "Objects");
+    for(size_t i = 0; i < stageOrder.size(); i++) {
+        const StageTotal& total = stageTotals[stageOrder[i]];
+        fprintf(stderr, "   %-24s %8lu %12.3f %12.3f %12.2f %11ld KB %11ld KB %10.0f\n", stageOrder[i].c_str(), total.count, total.seconds, total.maxSeconds,
+            total.seconds > 0 ? total.pixels / 1e6 / total.seconds : 0.0, total.maxMemoryDelta, total.maxPeakMemory, total.objects);
+    }
+}
+
+void imageRecordBegin(const char* file) {
+    if(!instrumentationEnabled) {
+        return;
+    }
+    delete currentRecord;
+    currentRecord = new ImageRecord;
+    currentRecord->file = file;
+}
+
+void imageRecordEnd() {
+    if(currentRecord == NULL) {
+        return;
+    }
+    ImageRecord* record = currentRecord;
+    currentRecord = NULL;
+
+    statsLock.Lock();
+    imageCount++;
+    for(size_t i = 0; i < record->stages.size(); i++) {
+        const StageRecord& stage = record->stages[i];
+        if(stageTotals.find(stage.name) == stageTotals.end()) {
+            StageTotal empty = {0, 0, 0, 0, 0, 0, 0};
+            stageTotals[stage.name] = empty;
+            stageOrder.push_back(stage.name);
+        }
+        StageTotal& total = stageTotals[stage.name];
+        total.count++;
+        total.seconds += stage.seconds;
+        total.maxSeconds = std::max(total.maxSeconds, stage.seconds);
+        total.maxMemoryDelta = total.count == 1 ? stage.memoryDelta : std::max(total.maxMemoryDelta, stage.memoryDelta);
+        total.maxPeakMemory = std::max(total.maxPeakMemory, stage.peakMemory);
+        total.pixels += stage.pixels;
+        total.objects += stage.objects > 0 ? stage.objects : 0;
+    }
+
+    if(statsFile != NULL) {
+        if(statsCSV) {
+            // Quote the file name, doubling its quotes
+            std::string quoted;
+            for(size_t i = 0; i < record->file.size(); i++) {
+                quoted += record->file[i];
+                if(record->file[i] == '"') {
+                    quoted += '"';
+                }
+            }
+            for(size_t i = 0; i < record->stages.size(); i++) {
+                const StageRecord& stage = record->stages[i];
+                fprintf(statsFile, "\"%s\",%s,%.6f,%ld,%ld,%lu,%ld\n", quoted.c_str(), stage.name, stage.seconds, stage.memoryDelta, stage.peakMemory, stage.pixels, stage.objects);
+            }
+        } else {
+            fprintf(statsFile, "{\"file\": \"%s\", \"stages\": [", jsonEscape(record->file).c_str());
+            for(size_t i = 0; i < record->stages.size(); i++) {
+                const StageRecord& stage = record->stages[i];
+                fprintf(statsFile, "%s{\"stage\": \"%s\", \"seconds\": %.6f, \"memoryDeltaKB\": %ld, \"peakKB\": %ld, \"pixels\": %lu",
+                    i > 0 ? ", " : "", stage.name, stage.seconds, stage.memoryDelta, stage.peakMemory, stage.pixels);
+                if(stage.objects >= 0) {
+                    fprintf(statsFile, ", \"objects\": %ld", stage.objects);
+                }
+                fprintf(statsFile, "}");
+            }
+            fprintf(statsFile, "]}\n");
+        }
+        fflush(statsFile);
+    }
+    statsLock.Unlock();
+
+    delete record;
+}
+
+ImageRecord* imageRecordSuspend() {
+    ImageRecord* record = currentRecord;
+    currentRecord = NULL;
+    return record;
+}
+
+void imageRecordResume(ImageRecord* record) {
+    currentRecord = record;
+}
+
+StageProbe::StageProbe(const char* name, const char* label) {
+    m_Name = name;
+    m_Start = 0;
+    m_StartMemory = 0;
+    m_PeakReset = false;
+    if(label != NULL) {
+        progress("> %s... ", label);
+    }
+    m_Label = label != NULL;
+    if(currentRecord != NULL) {
+        m_Start = wallTime();
+        m_StartMemory = currentResidentMemory();
+        m_PeakReset = resetHighWaterMark();
+    }
+}
+
+void StageProbe::Done(unsigned long pixels, long objects) {
+    if(currentRecord != NULL) {
+        StageRecord stage;
+        stage.name = m_Name;
+        stage.seconds = wallTime() - m_Start;
+        stage.memoryDelta = currentResidentMemory() - m_StartMemory;
+        long mark = m_PeakReset ? highWaterMark() : 0;
+        stage.peakMemory = mark > 0 ? mark : peakResidentMemory();
+        stage.pixels = pixels;
+        stage.objects = objects;
+        currentRecord->stages.push_back(stage);
+    }
+    if(m_Label) {
+        progress("[DONE]\n");
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+/* INCLUDES */
+
+#include <string>
+#include <vector>
+
+/* Measurements of one pipeline stage */
+struct StageRecord {
+    const char* name;
+    double seconds;             // Wall time
+    long memoryDelta;           // Change of the resident set size over the stage, in KB: what
+                                // the stage kept allocated (process wide, so concurrent scans
+                                // add to it)
+    long peakMemory;            // Peak resident set size during the stage, in KB. The kernel
+                                // high-water mark is reset when the stage starts, and it is
+                                // process wide: concurrent scans share it and reset it for each
+                                // other. Without /proc/self/clear_refs it is the process peak.
+    unsigned long pixels;       // Pixels processed
+    long objects;               // Label objects produced, -1 for stages that don't label
+};
+
+/* Stage measurements of one image */
+struct ImageRecord {
+    std::string file;
+    std::vector<StageRecord> stages;
+};
+
+/* @FUNCTIONS    */
+
+/* True while stage measurements are being recorded */
+extern bool instrumentationEnabled;
+
+/* Start recording. Each image record is appended to 'path', as CSV if it ends in ".csv" and as
+   JSON lines otherwise; with an empty path the records are only aggregated. */
+bool instrumentationStart(const char* path);
+
+/* Print the per stage totals of every image recorded since the start, and stop recording */
+void instrumentationFinish();
+
+/* Start and finish the record of an image. Records are per thread, so concurrent scans don't mix. */
+void imageRecordBegin(const char* file);
+void imageRecordEnd();
+
+/* Take the record of this thread away, and give it back. Meanwhile the stages the thread runs,
+   like the tiles of a tiled scan on its first worker, are not added to the image. */
+ImageRecord* imageRecordSuspend();
+void imageRecordResume(ImageRecord* record);
+
+/* Measures one stage and prints its progress line (none if label is NULL). Done() must be
+   called once the stage has actually run, which for ITK filters means after Update(). When
+   neither instrumentation nor progress is enabled it costs a branch. */
+class StageProbe {
+public:
+    StageProbe(const char* name, const char* label);
+    void Done(unsigned long pixels, long objects = -1);
+private:
+    const char* m_Name;
+    bool m_Label;
+    double m_Start;
+    long m_StartMemory;
+    bool m_PeakReset;           // The high-water mark was reset at the start
+};
+
+/* Peak resident set size of the process, in KB, including the peaks of the stages measured
+   before their high-water marks were reset */
+long peakResidentMemory();
+
+/* Current resident set size of the process, in KB (0 where /proc/self/statm doesn't exist) */
+long currentResidentMemory();
+
+/* Escape a string for a JSON record */
+std::string jsonEscape(const std::string& text);
+
+#endif
@@ -0,0 +1,143 @@
+/* INCLUDES */
+
+#include "outputWriter.h"
+#include "itkConditionVariable.h"
+#include "itkMultiThreader.h"
+#include "itkPNGImageIO.h"
+#include "itkSimpleMutexLock.h"
+#include <itksys/SystemTools.hxx>
+#include <deque>
+#include <string>
+#include <stdio.h>
+
+/* Images waiting to be encoded, each one holds a full resolution buffer */
+#define OUTPUT_QUEUE_LENGTH 8
+
+/* Image to be written, gray or color */
+struct WriteJob {
+    ImageType::Pointer gray;
+    ImageColorType::Pointer color;
+    std::string path;
+};
+
+static itk::MultiThreader::Pointer writerThreader;
+static int writerThread = -1;                   // -1 while no writer thread runs
+static itk::SimpleMutexLock writerLock;         // Protects the queue and writerStopping
+static itk::ConditionVariable::Pointer writerCondition;
+static std::deque<WriteJob> writerQueue;
+static bool writerStopping = false;
+static int compressionLevel = 0;
+
+/* @FUNCTIONS    */
+
+/* Encode an image with the configured compression */
+template<class TImage>
+static void encodeImage(TImage* image, const std::string& path) {
+    typedef itk::ImageFileWriter<TImage> WriterType;
+    typename WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(path);
+    writer->SetInput(image);
+    if(compressionLevel > 0 && itksys::SystemTools::LowerCase(itksys::SystemTools::GetFilenameLastExtension(path)) == ".png") {
+        itk::PNGImageIO::Pointer pngIO = itk::PNGImageIO::New();
+        pngIO->SetCompressionLevel(compressionLevel);
+        writer->SetImageIO(pngIO);
+        writer->SetUseCompression(true);
+    }
+    writer->Update();
+}
+
+static void runJob(const WriteJob& job) {
+    try {
+        if(job.gray.IsNotNull()) {
+            encodeImage(job.gray.GetPointer(), job.path);
+        } else {
+            encodeImage(job.color.GetPointer(), job.path);
+        }
+    } catch(itk::ExceptionObject& e) {
+        fprintf(stderr, "Could not write %s: %s\n", job.path.c_str(), e.GetDescription());
+    }
+}
+
+/* Writer thread: encode queued images until stopped and the queue is empty */
+static ITK_THREAD_RETURN_TYPE writerWorker(void*) {
+    writerLock.Lock();
+    while(true) {
+        while(writerQueue.empty() && !writerStopping) {
+            writerCondition->Wait(&writerLock);
+        }
+        if(writerQueue.empty()) {
+            break;
+        }
+        WriteJob job = writerQueue.front();
+        writerQueue.pop_front();
+        writerCondition->Broadcast();
+        writerLock.Unlock();
+
+        runJob(job);
+
+        writerLock.Lock();
+    }
+    writerLock.Unlock();
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+/* Queue a job, or run it if no writer thread runs */
+static void submitJob(const WriteJob& job) {
+    if(writerThread < 0) {
+        runJob(job);
+        return;
+    }
+    writerLock.Lock();
+    while(writerQueue.size() >= OUTPUT_QUEUE_LENGTH) {
+        writerCondition->Wait(&writerLock);
+    }
+    writerQueue.push_back(job);
+    writerCondition->Broadcast();
+    writerLock.Unlock();
+}
+
+void outputWriterStart() {
+    if(writerThread >= 0) {
+        return;
+    }
+    writerStopping = false;
+    writerCondition = itk::ConditionVariable::New();
+    writerThreader = itk::MultiThreader::New();
+    writerThread = writerThreader->SpawnThread(writerWorker, NULL);
+}
+
+void outputWriterFinish() {
+    if(writerThread < 0) {
+        return;
+    }
+    writerLock.Lock();
+    writerStopping = true;
+    writerCondition->Broadcast();
+    writerLock.Unlock();
+
+    writerThreader->TerminateThread(writerThread);
+    writerThread = -1;
+    writerThreader = NULL;
+    writerCondition = NULL;
+}
+
+void setOutputCompression(int level) {
+    compressionLevel = level;
+}
+
+void writeImage(ImageType::Pointer image, const char* path) {
+    image->DisconnectPipeline();
+    WriteJob job;
+    job.gray = image;
+    job.path = path;
+    submitJob(job);
+}
+
+void writeImage(ImageColorType::Pointer image, const char* path) {
+    image->DisconnectPipeline();
+    WriteJob job;
+    job.color = image;
+    job.path = path;
+    submitJob(job);
+}
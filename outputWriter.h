@@ -0,0 +1,25 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+/* INCLUDES */
+
+#include "coinPipeline.h"
+
+/* @FUNCTIONS    */
+
+/* Start the background writer thread. Images written from now on are queued and encoded by it,
+   at most OUTPUT_QUEUE_LENGTH at a time, further writes wait for room. */
+void outputWriterStart();
+
+/* Wait until every queued image is written and stop the writer thread */
+void outputWriterFinish();
+
+/* zlib level (1 = fastest, 9 = smallest) of the PNG files written, 0 for the ITK default */
+void setOutputCompression(int level);
+
+/* Write an image to a file, on the writer thread if it is running, else right away. The image
+   is disconnected from its pipeline and must not be modified afterwards. */
+void writeImage(ImageType::Pointer image, const char* path);
+void writeImage(ImageColorType::Pointer image, const char* path);
+
+#endif
@@ -0,0 +1,117 @@
+/* INCLUDES */
+
+#include "coinPipeline.h"
+#include "instrumentation.h"
+#include "itkImportImageFilter.h"
+#include <string.h>
+
+/* ITK Definitions */
+typedef itk::ImportImageFilter<ImageType::PixelType, 2> ImportFilterType;
+typedef itk::ImportImageFilter<RGBPixelType, 2> ImportColorFilterType;
+
+/* @FUNCTIONS    */
+
+/* Wrap 'width' x 'height' pixels of a caller buffer as an image, without copying them. The
+   container doesn't own the buffer, so it is never freed. */
+template <class TFilter>
+static typename TFilter::OutputImageType::Pointer importPixels(const unsigned char* pixels, unsigned int width, unsigned int height) {
+    typename TFilter::Pointer importFilter = TFilter::New();
+    typename TFilter::SizeType size;
+    size[0] = width;
+    size[1] = height;
+    typename TFilter::IndexType start;
+    start.Fill(0);
+    typename TFilter::RegionType region;
+    region.SetIndex(start);
+    region.SetSize(size);
+    importFilter->SetRegion(region);
+    double origin[2] = {0.0, 0.0};
+    importFilter->SetOrigin(origin);
+    double spacing[2] = {1.0, 1.0};
+    importFilter->SetSpacing(spacing);
+
+    typedef typename TFilter::OutputImageType::PixelType PixelType;
+    importFilter->SetImportPointer(reinterpret_cast<PixelType*>(const_cast<unsigned char*>(pixels)), (unsigned long) width * height, false);
+    importFilter->Update();
+
+    typename TFilter::OutputImageType::Pointer image = importFilter->GetOutput();
+    image->DisconnectPipeline();
+    return image;
+}
+
+/* Copy rows 'stride' bytes apart into a new packed image */
+template <class TImage>
+static typename TImage::Pointer copyPixels(const unsigned char* pixels, unsigned int width, unsigned int height, long stride) {
+    typename TImage::Pointer image = TImage::New();
+    typename TImage::SizeType size;
+    size[0] = width;
+    size[1] = height;
+    image->SetRegions(size);
+    image->Allocate();
+
+    size_t rowBytes = width * sizeof(typename TImage::PixelType);
+    unsigned char* out = reinterpret_cast<unsigned char*>(image->GetBufferPointer());
+    for(unsigned int y = 0; y < height; y++) {
+        memcpy(out + y * rowBytes, pixels + y * stride, rowBytes);
+    }
+    return image;
+}
+
+/* Scan a caller buffer */
+void scanPixels(const unsigned char* pixels, unsigned int width, unsigned int height, long stride, int format, const ScanOptions& options, std::vector<CoinResult>& results) {
+    if(pixels == NULL || width == 0 || height == 0 || (format != PIXELS_GRAY && format != PIXELS_RGB) || stride < (long) width * format) {
+        throw itk::ExceptionObject(__FILE__, __LINE__, "Invalid pixel buffer", ITK_LOCATION);
+    }
+
+    itk::TimeProbe totalTime;
+    totalTime.Start();
+    imageRecordBegin("buffer");
+
+    ScanOptions bufferOptions = options;
+    bufferOptions.tileSize = 0;
+    bufferOptions.outputImages &= ~OUTPUT_COLOR;
+
+    ImageType::Pointer image;
+    ImageType::Pointer thresholdImage;
+    ImageColorType::Pointer imageColor;
+    if(format == PIXELS_RGB) {
+        // The gray image, or the threshold mask when the scan doesn't need it, is derived
+        // straight from the rows. The colors are only read through their stride, so padded
+        // rows are wrapped whole as a wider image.
+        ImageType::SizeType size;
+        size[0] = width;
+        size[1] = height;
+        if(scanNeedsGray(bufferOptions)) {
+            image = ImageType::New();
+            image->SetRegions(size);
+            image->Allocate();
+            convertToGray(pixels, stride, image);
+        } else {
+            thresholdImage = applyColorThreshold(pixels, stride, size, THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0);
+        }
+        if(stride % sizeof(RGBPixelType) == 0) {
+            imageColor = importPixels<ImportColorFilterType>(pixels, stride / sizeof(RGBPixelType), height);
+        } else {
+            imageColor = copyPixels<ImageColorType>(pixels, width, height, stride);
+        }
+    } else if(!scanNeedsGray(bufferOptions)) {
+        // The mask is made straight from the rows, padded or not
+        ImageType::SizeType size;
+        size[0] = width;
+        size[1] = height;
+        thresholdImage = applyThreshold(pixels, stride, size, THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0);
+    } else if(stride == (long) width && !bufferOptions.lowMemory && !(bufferOptions.outputImages & OUTPUT_ANNOTATED)) {
+        image = importPixels<ImportFilterType>(pixels, width, height);
+    } else {
+        // The pyramid scan needs packed rows, the threshold runs in place in low memory mode,
+        // and the coins are drawn on the gray image for the annotated output, so neither may
+        // touch the caller buffer
+        image = copyPixels<ImageType>(pixels, width, height, stride);
+    }
+
+    scanDecodedImage(image, thresholdImage, imageColor, bufferOptions, results);
+
+    imageRecordEnd();
+    totalTime.Stop();
+    progress("> Time: buffer %ux%u - Total: %.3fs - Peak memory: %ld KB\n", width, height, totalTime.GetTotal(), peakResidentMemory());
+}
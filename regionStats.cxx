@@ -0,0 +1,189 @@
+/* INCLUDES */
+
+#include "regionStats.h"
+#include <algorithm>
+#include <math.h>
+
+/* @FUNCTIONS    */
+
+/* True if pixel x of a mask row is readable and part of the object */
+static inline bool isSet(const unsigned char* row, int x, int start, int end, unsigned char foreground) {
+    return row != NULL && x >= start && x < end && row[x] == foreground;
+}
+
+/* Root of a label, halving the path on the way */
+static unsigned int findRoot(std::vector<unsigned int>& parent, unsigned int label) {
+    while(parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+void addRegionAccumulator(RegionAccumulator& to, const RegionAccumulator& from) {
+    if(from.minY < to.minY || (from.minY == to.minY && from.firstX < to.firstX)) {
+        to.firstX = from.firstX;
+    }
+    to.pixels += from.pixels;
+    to.minX = std::min(to.minX, from.minX);
+    to.minY = std::min(to.minY, from.minY);
+    to.maxX = std::max(to.maxX, from.maxX);
+    to.maxY = std::max(to.maxY, from.maxY);
+    to.straightCrossings += from.straightCrossings;
+    to.diagonalCrossings += from.diagonalCrossings;
+    for(int c = 0; c < 3; c++) {
+        to.sum[c] += from.sum[c];
+        to.sumSquares[c] += from.sumSquares[c];
+    }
+}
+
+RegionStats finishRegionStats(const RegionAccumulator& accumulator) {
+    RegionStats region;
+    region.pixels = accumulator.pixels;
+    region.x = accumulator.minX;
+    region.y = accumulator.minY;
+    region.width = accumulator.maxX - accumulator.minX + 1;
+    region.height = accumulator.maxY - accumulator.minY + 1;
+    region.equivalentDiameter = 2 * sqrt(accumulator.pixels / M_PI);
+    // Cauchy-Crofton: half the mean number of crossings per unit of line over the directions,
+    // diagonal lines are 1/sqrt(2) apart
+    region.perimeter = M_PI / 8 * (accumulator.straightCrossings + accumulator.diagonalCrossings / M_SQRT2);
+    region.roundness = M_PI * region.equivalentDiameter / region.perimeter;
+    for(int c = 0; c < 3; c++) {
+        region.mean[c] = accumulator.sum[c] / accumulator.pixels;
+        region.variance[c] = std::max(accumulator.sumSquares[c] / accumulator.pixels - region.mean[c] * region.mean[c], 0.0);
+    }
+    return region;
+}
+
+void labelRegionWindow(const RegionWindow& window, std::vector<RegionAccumulator>& objects, RegionEdges* edges) {
+    int width = window.width;
+    int height = window.height;
+    int start = -window.context[0];
+    int end = width + window.context[2];
+    unsigned char foreground = window.foreground;
+
+    // Label 0 is the background, labels of the previous and current rows
+    std::vector<unsigned int> previous(width, 0);
+    std::vector<unsigned int> current(width, 0);
+    std::vector<unsigned int> parent(1, 0);
+    std::vector<RegionAccumulator> accumulators(1);
+    std::vector<unsigned int> top;
+    std::vector<unsigned int> left(height);
+    std::vector<unsigned int> right(height);
+
+    for(int y = 0; y < height; y++) {
+        const unsigned char* row = window.mask + y * window.maskStride;
+        const unsigned char* above = y > 0 || window.context[1] > 0 ? row - window.maskStride : NULL;
+        const unsigned char* below = y + 1 < height || window.context[3] > 0 ? row + window.maskStride : NULL;
+        const unsigned char* color = window.rgb != NULL ? window.rgb + y * window.rgbStride : NULL;
+        for(int x = 0; x < width; x++) {
+            if(row[x] != foreground) {
+                current[x] = 0;
+                continue;
+            }
+
+            unsigned int leftLabel = x > 0 ? current[x - 1] : 0;
+            unsigned int up = previous[x];
+            unsigned int label;
+            if(leftLabel == 0 && up == 0) {
+                label = parent.size();
+                parent.push_back(label);
+                RegionAccumulator empty = {0, window.originX + x, window.originY + y, window.originY + y, window.originX + x, window.originY + y, 0, 0, {0, 0, 0}, {0, 0, 0}};
+                empty.minX = empty.firstX;
+                accumulators.push_back(empty);
+            } else if(leftLabel == 0 || leftLabel == up) {
+                label = up;
+            } else if(up == 0) {
+                label = leftLabel;
+            } else {
+                // Both neighbours are the same object, the smallest label becomes the root
+                label = up;
+                unsigned int a = findRoot(parent, leftLabel);
+                unsigned int b = findRoot(parent, up);
+                if(a != b) {
+                    parent[std::max(a, b)] = std::min(a, b);
+                }
+            }
+            current[x] = label;
+
+            RegionAccumulator& accumulator = accumulators[label];
+            long imageX = window.originX + x;
+            accumulator.pixels++;
+            accumulator.minX = std::min(accumulator.minX, imageX);
+            accumulator.maxX = std::max(accumulator.maxX, imageX);
+            accumulator.maxY = window.originY + y;
+            accumulator.straightCrossings += !isSet(row, x - 1, start, end, foreground) + !isSet(row, x + 1, start, end, foreground) +
+                !isSet(above, x, start, end, foreground) + !isSet(below, x, start, end, foreground);
+            accumulator.diagonalCrossings += !isSet(above, x - 1, start, end, foreground) + !isSet(above, x + 1, start, end, foreground) +
+                !isSet(below, x - 1, start, end, foreground) + !isSet(below, x + 1, start, end, foreground);
+            if(color != NULL) {
+                for(int c = 0; c < 3; c++) {
+                    double value = color[3 * x + c];
+                    accumulator.sum[c] += value;
+                    accumulator.sumSquares[c] += value * value;
+                }
+            }
+        }
+        if(edges != NULL && width > 0) {
+            left[y] = current[0];
+            right[y] = current[width - 1];
+            if(y == 0) {
+                top = current;
+            }
+        }
+        previous.swap(current);
+    }
+
+    // Roots have the smallest label of their object, so they come first
+    std::vector<unsigned int> objectOf(parent.size(), 0);
+    objects.clear();
+    for(unsigned int label = 1; label < parent.size(); label++) {
+        unsigned int root = findRoot(parent, label);
+        if(root == label) {
+            objects.push_back(accumulators[label]);
+            objectOf[label] = objects.size();
+        } else {
+            addRegionAccumulator(objects[objectOf[root] - 1], accumulators[label]);
+            objectOf[label] = objectOf[root];
+        }
+    }
+
+    if(edges != NULL) {
+        edges->top.resize(top.size());
+        edges->bottom.resize(previous.size());
+        edges->left.resize(left.size());
+        edges->right.resize(right.size());
+        for(size_t i = 0; i < top.size(); i++) {
+            edges->top[i] = objectOf[top[i]];
+        }
+        for(size_t i = 0; i < previous.size(); i++) {
+            edges->bottom[i] = height > 0 ? objectOf[previous[i]] : 0;
+        }
+        for(int i = 0; i < height; i++) {
+            edges->left[i] = objectOf[left[i]];
+            edges->right[i] = objectOf[right[i]];
+        }
+    }
+}
+
+void labelRegionStats(const unsigned char* mask, int width, int height, unsigned char foreground, const unsigned char* rgb, long rgbStride, std::vector<RegionStats>& regions) {
+    RegionWindow window;
+    window.mask = mask;
+    window.maskStride = width;
+    window.width = width;
+    window.height = height;
+    window.context[0] = window.context[1] = window.context[2] = window.context[3] = 0;
+    window.foreground = foreground;
+    window.rgb = rgb;
+    window.rgbStride = rgbStride;
+    window.originX = 0;
+    window.originY = 0;
+
+    std::vector<RegionAccumulator> objects;
+    labelRegionWindow(window, objects, NULL);
+    regions.clear();
+    for(size_t i = 0; i < objects.size(); i++) {
+        regions.push_back(finishRegionStats(objects[i]));
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef REGION_STATS_H
+#define REGION_STATS_H
+
+/* INCLUDES */
+
+#include <vector>
+
+/* Statistics of one connected object */
+struct RegionStats {
+    unsigned long pixels;           // Pixel count
+    unsigned int x;                 // Bounding box
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+    double equivalentDiameter;      // Diameter of the disk with the same area
+    double perimeter;               // Crofton estimate over 4 directions
+    double roundness;               // Perimeter of the equivalent disk over perimeter, about 1 for a disk
+    double mean[3];                 // Color averages (R, G, B) over the object mask
+    double variance[3];
+};
+
+/* Measures of an object, or of the part of it inside a window, which add up */
+struct RegionAccumulator {
+    unsigned long pixels;
+    long firstX;                        // Column of the first pixel in raster order, on row minY
+    long minX;
+    long minY;
+    long maxX;
+    long maxY;
+    unsigned long straightCrossings;    // Object edges crossed by horizontal and vertical lines
+    unsigned long diagonalCrossings;    // Object edges crossed by diagonal lines
+    double sum[3];
+    double sumSquares[3];
+};
+
+/* Window of a binary image to label */
+struct RegionWindow {
+    const unsigned char* mask;      // First pixel of the window
+    long maskStride;                // Bytes between mask rows
+    int width;
+    int height;
+    int context[4];                 // Mask pixels readable left, above, right and below the window
+    unsigned char foreground;
+    const unsigned char* rgb;       // Color of the first pixel (interleaved R, G, B), NULL to skip colors
+    long rgbStride;                 // Bytes between color rows
+    long originX;                   // Image coordinates of the first pixel
+    long originY;
+};
+
+/* Objects of a window on each of its edges: 0 for background, else 1 + the object index */
+struct RegionEdges {
+    std::vector<unsigned int> top;
+    std::vector<unsigned int> bottom;
+    std::vector<unsigned int> left;
+    std::vector<unsigned int> right;
+};
+
+/* Label the 4-connected objects of a window (pixels equal to 'foreground', same connectivity
+   as itk::BinaryImageToShapeLabelMapFilter) and gather their measures in one raster sweep: each
+   pixel is labeled from its left and upper neighbours, its measures are added to its
+   provisional label, and labels found to be the same object are merged with a union-find at
+   the end. Objects are returned in raster order of their first pixel, with the labels of the
+   window edges if 'edges' is not NULL, so objects cut by window borders can be merged.
+
+   Mask pixels outside the window and its context are background; the context only feeds the
+   perimeter of the objects inside the window. */
+void labelRegionWindow(const RegionWindow& window, std::vector<RegionAccumulator>& objects, RegionEdges* edges);
+
+/* Add the measures of another part of the same object */
+void addRegionAccumulator(RegionAccumulator& to, const RegionAccumulator& from);
+
+/* Statistics of a whole object */
+RegionStats finishRegionStats(const RegionAccumulator& accumulator);
+
+/* Label a whole binary image and return the statistics of its objects. 'mask' is 'width' x
+   'height' with rows of 'width' bytes. 'rgb' points at the color of the first mask pixel, with
+   rows of 'rgbStride' bytes; with a NULL 'rgb' the colors are not measured. */
+void labelRegionStats(const unsigned char* mask, int width, int height, unsigned char foreground, const unsigned char* rgb, long rgbStride, std::vector<RegionStats>& regions);
+
+#endif
@@ -0,0 +1,285 @@
+/* INCLUDES */
+
+#include "resultCache.h"
+#include "coinPipeline.h"
+#include <itksys/SystemTools.hxx>
+#include <itksys/Directory.hxx>
+#include <itksys/MD5.h>
+#include <algorithm>
+#include <fstream>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+/* Version of the entry format, part of every key */
+#define CACHE_VERSION 1
+
+/* Extension of the entries, the temporary files of a write have another one */
+#define CACHE_EXTENSION ".result"
+
+/* Eviction brings the entries down to this part of the size bound, so it doesn't run again
+   on the next store */
+#define CACHE_EVICT_TO 0.9
+
+/* Temporary files this old were left by a process that died while writing */
+#define CACHE_STALE_SECONDS 3600
+
+/* Entry file found by an eviction */
+struct CacheFile {
+    std::string path;
+    struct timespec modified;
+    unsigned long size;
+};
+
+/* @FUNCTIONS    */
+
+/* Least recently used first. Entries used within the same clock tick are ordered by name, so
+   every process evicts the same ones. */
+static bool olderFile(const CacheFile& a, const CacheFile& b) {
+    if(a.modified.tv_sec != b.modified.tv_sec) {
+        return a.modified.tv_sec < b.modified.tv_sec;
+    }
+    if(a.modified.tv_nsec != b.modified.tv_nsec) {
+        return a.modified.tv_nsec < b.modified.tv_nsec;
+    }
+    return a.path < b.path;
+}
+
+/* True if both are the same file, unchanged */
+static bool sameFile(const struct stat& a, const struct stat& b) {
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+        a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec &&
+        a.st_ctim.tv_sec == b.st_ctim.tv_sec && a.st_ctim.tv_nsec == b.st_ctim.tv_nsec;
+}
+
+/* Everything the results of a scan depend on besides the image */
+static std::string scanFingerprint(const ScanOptions& options) {
+    char text[512];
+    snprintf(text, sizeof(text), "coinScanner results %d - threshold %d %d - radius %d - margin %.17g - pyramid %d - tiles %u - all objects %d\n",
+        CACHE_VERSION, THRESHOLD_LOWER, THRESHOLD_UPPER, CLOSING_RADIUS, MARGEM_ERRO, options.pyramidFactor > 1 ? options.pyramidFactor : 1, options.tileSize, SHOW_ALL_OUTPUT);
+    std::string fingerprint = text;
+    const std::vector<CoinSpec>& entries = coinCatalog.GetEntries();
+    for(size_t i = 0; i < entries.size(); i++) {
+        const CoinSpec& spec = entries[i];
+        snprintf(text, sizeof(text), "%ld %ld %.17g %d-%d %d-%d %d-%d ", spec.length, spec.area, spec.tolerance,
+            spec.colorMin[0], spec.colorMax[0], spec.colorMin[1], spec.colorMax[1], spec.colorMin[2], spec.colorMax[2]);
+        fingerprint += text + spec.name + "\n";
+    }
+    return fingerprint;
+}
+
+/* Catalog name of a cached coin, NULL if the catalog has no such coin */
+static const char* catalogName(const std::string& name) {
+    const std::vector<CoinSpec>& entries = coinCatalog.GetEntries();
+    for(size_t i = 0; i < entries.size(); i++) {
+        if(entries[i].name == name) {
+            return entries[i].name.c_str();
+        }
+    }
+    return NULL;
+}
+
+ResultCache::ResultCache(const std::string& directory, unsigned long maxBytes) {
+    m_Directory = directory;
+    m_MaxBytes = maxBytes;
+    m_Bytes = 0;
+    m_Lookups = 0;
+    m_Hits = 0;
+    m_Evictions = 0;
+    m_Serial = 0;
+}
+
+bool ResultCache::Open(std::string& error) {
+    if(!itksys::SystemTools::MakeDirectory(m_Directory.c_str())) {
+        error = "could not create " + m_Directory;
+        return false;
+    }
+    itksys::Directory directory;
+    if(!directory.Load(m_Directory.c_str())) {
+        error = "could not read " + m_Directory;
+        return false;
+    }
+    long stale = (long) time(NULL) - CACHE_STALE_SECONDS;
+    for(unsigned long i = 0; i < directory.GetNumberOfFiles(); i++) {
+        std::string name = directory.GetFile(i);
+        std::string path = m_Directory + "/" + name;
+        if(itksys::SystemTools::GetFilenameLastExtension(name) == CACHE_EXTENSION) {
+            m_Bytes += itksys::SystemTools::FileLength(path.c_str());
+        } else if(name.find(CACHE_EXTENSION ".tmp") != std::string::npos && itksys::SystemTools::ModifiedTime(path.c_str()) < stale) {
+            itksys::SystemTools::RemoveFile(path.c_str());
+        }
+    }
+    return true;
+}
+
+std::string ResultCache::EntryPath(const std::string& key) const {
+    return m_Directory + "/" + key + CACHE_EXTENSION;
+}
+
+bool ResultCache::Lookup(const char* path, const ScanOptions& options, CacheKey& key, std::vector<CoinResult>& results) {
+    key.digest.clear();
+    key.path = path;
+    int image = open(path, O_RDONLY);
+    if(image < 0) {
+        return false;
+    }
+
+    // Key: the image bytes, streamed, then the parameters
+    itksysMD5* md5 = itksysMD5_New();
+    itksysMD5_Initialize(md5);
+    std::vector<char> buffer(64 * 1024);
+    bool hashed = fstat(image, &key.file) == 0;
+    while(hashed) {
+        ssize_t count = read(image, &buffer[0], buffer.size());
+        if(count < 0 && errno == EINTR) {
+            continue;
+        }
+        if(count <= 0) {
+            hashed = count == 0;
+            break;
+        }
+        itksysMD5_Append(md5, reinterpret_cast<const unsigned char*>(&buffer[0]), (int) count);
+    }
+    std::string fingerprint = scanFingerprint(options);
+    itksysMD5_Append(md5, reinterpret_cast<const unsigned char*>(fingerprint.data()), (int) fingerprint.size());
+    char hex[32];
+    itksysMD5_FinalizeHex(md5, hex);
+    itksysMD5_Delete(md5);
+
+    // The bytes hashed must be the ones of the file at 'path' now, which the scan decodes
+    struct stat hashedFile;
+    hashed = hashed && fstat(image, &hashedFile) == 0 && sameFile(key.file, hashedFile);
+    struct stat current;
+    hashed = hashed && stat(path, &current) == 0 && sameFile(key.file, current);
+    close(image);
+    if(!hashed) {
+        return false;
+    }
+    key.digest.assign(hex, sizeof(hex));
+
+    // Entry: a header with the number of coins, then one coin per line
+    std::vector<CoinResult> cached;
+    std::string entryPath = EntryPath(key.digest);
+    std::ifstream entry(entryPath.c_str());
+    std::string line;
+    unsigned int count = 0;
+    bool valid = entry && std::getline(entry, line) && sscanf(line.c_str(), "coinScanner results %*d %u", &count) == 1;
+    for(unsigned int i = 0; valid && i < count; i++) {
+        CoinResult result;
+        int nameStart = 0;
+        valid = std::getline(entry, line) && sscanf(line.c_str(), "%u %ld %u %u %u %u %lu %lf %d %d %d %n", &result.object, &result.length,
+            &result.x, &result.y, &result.width, &result.height, &result.area, &result.roundness, &result.r, &result.g, &result.b, &nameStart) == 11 && nameStart > 0;
+        if(valid) {
+            result.type = catalogName(line.substr(nameStart));
+            valid = result.type != NULL;
+            cached.push_back(result);
+        }
+    }
+    if(valid) {
+        // Most recently used
+        utime(entryPath.c_str(), NULL);
+        results.insert(results.end(), cached.begin(), cached.end());
+    }
+
+    m_Lock.Lock();
+    m_Lookups++;
+    if(valid) {
+        m_Hits++;
+    }
+    m_Lock.Unlock();
+    return valid;
+}
+
+void ResultCache::Store(const CacheKey& key, const std::vector<CoinResult>& results) {
+    // An image replaced or modified since it was hashed may have been decoded with new bytes
+    struct stat current;
+    if(key.digest.empty() || stat(key.path.c_str(), &current) != 0 || !sameFile(key.file, current)) {
+        return;
+    }
+    std::string text;
+    char line[512];
+    snprintf(line, sizeof(line), "coinScanner results %d %lu\n", CACHE_VERSION, (unsigned long) results.size());
+    text += line;
+    for(size_t i = 0; i < results.size(); i++) {
+        const CoinResult& result = results[i];
+        snprintf(line, sizeof(line), "%u %ld %u %u %u %u %lu %.17g %d %d %d ", result.object, result.length, result.x, result.y,
+            result.width, result.height, result.area, result.roundness, result.r, result.g, result.b);
+        text += line + std::string(result.type) + "\n";
+    }
+
+    // Written aside and renamed into place, so no reader sees a partial entry
+    m_Lock.Lock();
+    unsigned long serial = m_Serial++;
+    m_Lock.Unlock();
+    std::string entryPath = EntryPath(key.digest);
+    snprintf(line, sizeof(line), ".tmp%ld-%lu", (long) getpid(), serial);
+    std::string temporaryPath = entryPath + line;
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if(file == NULL) {
+        return;
+    }
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    written = fclose(file) == 0 && written;
+    unsigned long replaced = itksys::SystemTools::FileExists(entryPath.c_str()) ? itksys::SystemTools::FileLength(entryPath.c_str()) : 0;
+    if(!written || rename(temporaryPath.c_str(), entryPath.c_str()) != 0) {
+        itksys::SystemTools::RemoveFile(temporaryPath.c_str());
+        return;
+    }
+
+    m_Lock.Lock();
+    m_Bytes = m_Bytes + text.size() - std::min(replaced, m_Bytes + text.size());
+    if(m_Bytes > m_MaxBytes) {
+        Evict();
+    }
+    m_Lock.Unlock();
+}
+
+/* Remove the least recently used entries, with the lock held. The directory is listed again,
+   so the entries of other processes count too. */
+void ResultCache::Evict() {
+    itksys::Directory directory;
+    if(!directory.Load(m_Directory.c_str())) {
+        return;
+    }
+    std::vector<CacheFile> files;
+    unsigned long total = 0;
+    for(unsigned long i = 0; i < directory.GetNumberOfFiles(); i++) {
+        std::string name = directory.GetFile(i);
+        if(itksys::SystemTools::GetFilenameLastExtension(name) != CACHE_EXTENSION) {
+            continue;
+        }
+        // Modification times to the nanosecond, entries are often used within one second
+        CacheFile file;
+        file.path = m_Directory + "/" + name;
+        struct stat status;
+        if(stat(file.path.c_str(), &status) != 0) {
+            continue;
+        }
+        file.modified = status.st_mtim;
+        file.size = status.st_size;
+        total += file.size;
+        files.push_back(file);
+    }
+    std::sort(files.begin(), files.end(), olderFile);
+
+    unsigned long target = (unsigned long) (m_MaxBytes * CACHE_EVICT_TO);
+    for(size_t i = 0; i < files.size() && total > target; i++) {
+        // Another process may have removed it first
+        if(itksys::SystemTools::RemoveFile(files[i].path.c_str())) {
+            m_Evictions++;
+        }
+        total -= files[i].size;
+    }
+    m_Bytes = total;
+}
+
+void ResultCache::Report() const {
+    m_Lock.Lock();
+    fprintf(stderr, "> Cache: %lu lookups - %lu hits (%.1f%%) - %lu evictions - %lu KB in %s\n", m_Lookups, m_Hits,
+        m_Lookups > 0 ? 100.0 * m_Hits / m_Lookups : 0.0, m_Evictions, m_Bytes / 1024, m_Directory.c_str());
+    m_Lock.Unlock();
+}
@@ -0,0 +1,66 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+/* INCLUDES */
+
+#include "coinScanner.h"
+#include "itkSimpleFastMutexLock.h"
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+/* On disk cache of scan results, so an image scanned again is not decoded at all.
+
+   The key of an image is the MD5 of its file bytes and of a fingerprint of everything the
+   results depend on: threshold bounds, closing radius, error margin, pyramid factor, tile
+   size and the coin catalog entries. Each entry is a small text file named after its key,
+   holding the coins found. Entries are written to a temporary file and renamed, so concurrent
+   readers, threads or processes, see either the whole entry or none.
+
+   Results are only stored if the image file is still the one that was hashed, by its inode,
+   size and modification and change times, so an image replaced while it was scanned doesn't
+   store its results under the key of the old bytes.
+
+   Hits refresh the modification time of their entry, and when the entries of the directory
+   grow past the size bound the least recently used ones are removed. */
+
+/* Key of an image file, with the state of the file when it was hashed */
+struct CacheKey {
+    std::string digest;         // Empty if the file couldn't be hashed, then nothing is stored
+    std::string path;
+    struct stat file;
+};
+
+class ResultCache {
+public:
+    ResultCache(const std::string& directory, unsigned long maxBytes);
+
+    /* Create the directory if needed and add up the size of its entries. On failure 'error'
+       describes the problem. */
+    bool Open(std::string& error);
+
+    /* Look an image file up. Sets 'key' and appends the cached coins to results on a hit. */
+    bool Lookup(const char* path, const ScanOptions& options, CacheKey& key, std::vector<CoinResult>& results);
+
+    /* Store the coins found in an image under the key of its lookup, unless the file changed
+       since */
+    void Store(const CacheKey& key, const std::vector<CoinResult>& results);
+
+    /* Print the lookups, hit rate, evictions and size to stderr */
+    void Report() const;
+
+private:
+    std::string EntryPath(const std::string& key) const;
+    void Evict();
+
+    std::string m_Directory;
+    unsigned long m_MaxBytes;
+    unsigned long m_Bytes;              // Size of the entries, as seen by this process
+    unsigned long m_Lookups;
+    unsigned long m_Hits;
+    unsigned long m_Evictions;
+    unsigned long m_Serial;             // Numbers the temporary files of this process
+    mutable itk::SimpleFastMutexLock m_Lock;
+};
+
+#endif
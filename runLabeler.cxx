@@ -0,0 +1,229 @@
+/* INCLUDES */
+
+#include "runLabeler.h"
+#include <algorithm>
+
+/* @FUNCTIONS    */
+
+/* Root of a label, halving the path on the way */
+static unsigned int findRoot(std::vector<unsigned int>& parent, unsigned int label) {
+    while(parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+/* Join two labels, the smallest one becomes the root */
+static void joinLabels(std::vector<unsigned int>& parent, unsigned int a, unsigned int b) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if(a != b) {
+        parent[std::max(a, b)] = std::min(a, b);
+    }
+}
+
+/* True if pixel x of a mask row is inside the image and part of the object */
+static inline bool isSet(const unsigned char* row, int x, int width, unsigned char foreground) {
+    return row != NULL && x >= 0 && x < width && row[x] == foreground;
+}
+
+RunLabeler::RunLabeler(const unsigned char* mask, int width, int height, unsigned char foreground, unsigned int bands) {
+    m_Mask = mask;
+    m_Width = width;
+    m_Height = height;
+    m_Foreground = foreground;
+    bands = std::max(1, std::min<int>(bands, height));
+    m_Bands.resize(bands);
+    for(unsigned int b = 0; b < bands; b++) {
+        m_Bands[b].firstRow = (long) height * b / bands;
+        m_Bands[b].rows = (long) height * (b + 1) / bands - m_Bands[b].firstRow;
+    }
+}
+
+void RunLabeler::LabelBand(unsigned int index) {
+    RunBand& band = m_Bands[index];
+    std::vector<unsigned int> parent;
+    std::vector<RegionAccumulator> accumulators;
+    band.runs.clear();
+    band.rowStart.assign(1, 0);
+
+    for(int y = band.firstRow; y < band.firstRow + band.rows; y++) {
+        const unsigned char* row = m_Mask + (size_t) y * m_Width;
+        size_t above = band.rowStart[band.rowStart.size() - (y > band.firstRow ? 2 : 1)];
+        size_t aboveEnd = band.runs.size();
+        int x = 0;
+        while(x < m_Width) {
+            if(row[x] != m_Foreground) {
+                x++;
+                continue;
+            }
+            PixelRun run;
+            run.start = x;
+            while(x < m_Width && row[x] == m_Foreground) {
+                x++;
+            }
+            run.end = x;
+
+            // Runs of the row above overlapping this one are the same object
+            while(above < aboveEnd && band.runs[above].end <= run.start) {
+                above++;
+            }
+            unsigned int label = parent.size();
+            for(size_t a = above; a < aboveEnd && band.runs[a].start < run.end; a++) {
+                if(label == parent.size()) {
+                    label = band.runs[a].object;
+                } else {
+                    joinLabels(parent, label, band.runs[a].object);
+                }
+            }
+            if(label == parent.size()) {
+                parent.push_back(label);
+                RegionAccumulator empty = {0, run.start, run.start, y, run.end - 1, y, 0, 0, {0, 0, 0}, {0, 0, 0}};
+                accumulators.push_back(empty);
+            }
+            run.object = label;
+            band.runs.push_back(run);
+
+            RegionAccumulator& accumulator = accumulators[label];
+            accumulator.pixels += run.end - run.start;
+            accumulator.minX = std::min<long>(accumulator.minX, run.start);
+            accumulator.maxX = std::max<long>(accumulator.maxX, run.end - 1);
+            accumulator.maxY = y;
+        }
+        band.rowStart.push_back(band.runs.size());
+    }
+
+    // Roots have the smallest label of their object, so they come first
+    std::vector<unsigned int> objectOf(parent.size(), 0);
+    band.objects.clear();
+    for(unsigned int label = 0; label < parent.size(); label++) {
+        unsigned int root = findRoot(parent, label);
+        if(root == label) {
+            objectOf[label] = band.objects.size();
+            band.objects.push_back(accumulators[label]);
+        } else {
+            objectOf[label] = objectOf[root];
+            addRegionAccumulator(band.objects[objectOf[root]], accumulators[label]);
+        }
+    }
+    for(size_t i = 0; i < band.runs.size(); i++) {
+        band.runs[i].object = objectOf[band.runs[i].object];
+    }
+}
+
+void RunLabeler::Merge() {
+    std::vector<unsigned int> offsets(m_Bands.size() + 1, 0);
+    for(size_t b = 0; b < m_Bands.size(); b++) {
+        offsets[b + 1] = offsets[b] + m_Bands[b].objects.size();
+    }
+    std::vector<unsigned int> parent(offsets.back());
+    for(size_t i = 0; i < parent.size(); i++) {
+        parent[i] = i;
+    }
+
+    // Overlapping runs on both sides of a band border are the same object
+    for(size_t b = 0; b + 1 < m_Bands.size(); b++) {
+        const RunBand& upper = m_Bands[b];
+        const RunBand& lower = m_Bands[b + 1];
+        if(upper.rows == 0 || lower.rows == 0) {
+            continue;
+        }
+        size_t a = upper.rowStart[upper.rows - 1];
+        size_t aEnd = upper.rowStart[upper.rows];
+        for(size_t i = lower.rowStart[0]; i < lower.rowStart[1]; i++) {
+            const PixelRun& run = lower.runs[i];
+            while(a < aEnd && upper.runs[a].end <= run.start) {
+                a++;
+            }
+            for(size_t j = a; j < aEnd && upper.runs[j].start < run.end; j++) {
+                joinLabels(parent, offsets[b] + upper.runs[j].object, offsets[b + 1] + run.object);
+            }
+        }
+    }
+
+    // Bands are in row order, so roots are in raster order of their first pixel
+    std::vector<unsigned int> objectOf(parent.size(), 0);
+    m_Objects.clear();
+    for(size_t b = 0; b < m_Bands.size(); b++) {
+        RunBand& band = m_Bands[b];
+        for(size_t i = 0; i < band.objects.size(); i++) {
+            unsigned int label = offsets[b] + i;
+            unsigned int root = findRoot(parent, label);
+            if(root == label) {
+                objectOf[label] = m_Objects.size();
+                m_Objects.push_back(band.objects[i]);
+            } else {
+                objectOf[label] = objectOf[root];
+                addRegionAccumulator(m_Objects[objectOf[root]], band.objects[i]);
+            }
+        }
+        for(size_t i = 0; i < band.runs.size(); i++) {
+            band.runs[i].object = objectOf[offsets[b] + band.runs[i].object];
+        }
+        band.objects.clear();
+    }
+    m_Measured.clear();
+    m_Slot.assign(m_Objects.size(), 0);
+}
+
+void RunLabeler::Select(unsigned int object) {
+    if(m_Slot[object] == 0) {
+        m_Measured.push_back(object);
+        m_Slot[object] = m_Measured.size();
+    }
+}
+
+void RunLabeler::MeasureBand(unsigned int index, const unsigned char* rgb, long rgbStride) {
+    RunBand& band = m_Bands[index];
+    RegionAccumulator empty = {0, 0, 0, 0, 0, 0, 0, 0, {0, 0, 0}, {0, 0, 0}};
+    band.objects.assign(m_Measured.size(), empty);
+
+    for(int r = 0; r < band.rows; r++) {
+        int y = band.firstRow + r;
+        const unsigned char* row = m_Mask + (size_t) y * m_Width;
+        const unsigned char* above = y > 0 ? row - m_Width : NULL;
+        const unsigned char* below = y + 1 < m_Height ? row + m_Width : NULL;
+        const unsigned char* color = rgb != NULL ? rgb + y * rgbStride : NULL;
+        for(size_t i = band.rowStart[r]; i < band.rowStart[r + 1]; i++) {
+            const PixelRun& run = band.runs[i];
+            if(m_Slot[run.object] == 0) {
+                continue;
+            }
+            RegionAccumulator& accumulator = band.objects[m_Slot[run.object] - 1];
+
+            // Both run ends face the background
+            accumulator.straightCrossings += 2;
+            for(int x = run.start; x < run.end; x++) {
+                accumulator.straightCrossings += !isSet(above, x, m_Width, m_Foreground) + !isSet(below, x, m_Width, m_Foreground);
+                accumulator.diagonalCrossings += !isSet(above, x - 1, m_Width, m_Foreground) + !isSet(above, x + 1, m_Width, m_Foreground) +
+                    !isSet(below, x - 1, m_Width, m_Foreground) + !isSet(below, x + 1, m_Width, m_Foreground);
+            }
+            if(color != NULL) {
+                for(int x = run.start; x < run.end; x++) {
+                    for(int c = 0; c < 3; c++) {
+                        double value = color[3 * x + c];
+                        accumulator.sum[c] += value;
+                        accumulator.sumSquares[c] += value * value;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void RunLabeler::FinishMeasures() {
+    for(size_t b = 0; b < m_Bands.size(); b++) {
+        RunBand& band = m_Bands[b];
+        for(size_t i = 0; i < band.objects.size(); i++) {
+            RegionAccumulator& object = m_Objects[m_Measured[i]];
+            object.straightCrossings += band.objects[i].straightCrossings;
+            object.diagonalCrossings += band.objects[i].diagonalCrossings;
+            for(int c = 0; c < 3; c++) {
+                object.sum[c] += band.objects[i].sum[c];
+                object.sumSquares[c] += band.objects[i].sumSquares[c];
+            }
+        }
+        band.objects.clear();
+    }
+}
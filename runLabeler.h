@@ -0,0 +1,73 @@
+#ifndef RUN_LABELER_H
+#define RUN_LABELER_H
+
+/* INCLUDES */
+
+#include "regionStats.h"
+#include <vector>
+#include <stddef.h>
+
+/* Foreground pixels start to end - 1 of a row */
+struct PixelRun {
+    int start;
+    int end;
+    unsigned int object;    // Object of the band while labeling, object of the image after Merge()
+};
+
+/* Runs and objects of a band of rows */
+struct RunBand {
+    int firstRow;
+    int rows;
+    std::vector<PixelRun> runs;             // Raster order
+    std::vector<size_t> rowStart;           // First run of each row, plus the end of the last row
+    std::vector<RegionAccumulator> objects; // Objects of the band, then the band part of the measured objects
+};
+
+/* Connected object labeling on run-length encoded rows, in two steps so most objects are never
+   fully measured:
+
+   1. LabelBand() encodes the rows of a band as runs and labels them from the overlapping runs
+      of the row above (4-connectivity, same objects as labelRegionStats), keeping only the
+      pixel count, bounding box and first pixel of each object. Merge() joins the objects across
+      band borders with a union-find on the runs of the rows on each side.
+   2. MeasureBand() adds the perimeter crossings and colors of the objects marked with Select(),
+      visiting only their runs, and FinishMeasures() adds the bands up.
+
+   Bands are independent, so LabelBand() and MeasureBand() may run concurrently on different
+   bands. */
+class RunLabeler {
+public:
+    /* 'mask' is 'width' x 'height' with rows of 'width' bytes, split into 'bands' bands */
+    RunLabeler(const unsigned char* mask, int width, int height, unsigned char foreground, unsigned int bands);
+
+    unsigned int GetNumberOfBands() const { return m_Bands.size(); }
+    void LabelBand(unsigned int band);
+    void Merge();
+
+    /* Objects in raster order of their first pixel, with pixel count, bounding box and first
+       pixel only, until they are measured */
+    const std::vector<RegionAccumulator>& GetObjects() const { return m_Objects; }
+
+    /* Mark an object to be measured, before any MeasureBand() */
+    void Select(unsigned int object);
+
+    /* 'rgb' points at the color of the first mask pixel, with rows of 'rgbStride' bytes; with a
+       NULL 'rgb' the colors are not measured */
+    void MeasureBand(unsigned int band, const unsigned char* rgb, long rgbStride);
+    void FinishMeasures();
+
+    /* Statistics of a measured object */
+    RegionStats GetStats(unsigned int object) const { return finishRegionStats(m_Objects[object]); }
+
+private:
+    const unsigned char* m_Mask;
+    int m_Width;
+    int m_Height;
+    unsigned char m_Foreground;
+    std::vector<RunBand> m_Bands;
+    std::vector<RegionAccumulator> m_Objects;
+    std::vector<unsigned int> m_Measured;   // Selected objects
+    std::vector<unsigned int> m_Slot;       // 1 + index in m_Measured of each object, 0 if not selected
+};
+
+#endif
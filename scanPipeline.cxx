@@ -0,0 +1,91 @@
+/* INCLUDES */
+
+#include "scanPipeline.h"
+#include "fastClosing.h"
+#include "instrumentation.h"
+#include "thresholdMask.h"
+
+/* @FUNCTIONS    */
+
+ScanPipeline::ScanPipeline(const ScanOptions& options) {
+    m_Options = options;
+    m_Reader = ReaderColorType::New();
+    m_Mask = ImageType::New();
+
+    if(options.closingEngine == CLOSING_ITK) {
+        StructuringElementType structuringElement;
+        structuringElement.SetRadius(CLOSING_RADIUS);
+        structuringElement.CreateStructuringElement();
+        m_Closing = BinaryMorphologicalClosingImageFilterType::New();
+        m_Closing->SetInput(m_Mask);
+        m_Closing->SetKernel(structuringElement);
+    } else {
+        m_Closed = ImageType::New();
+    }
+}
+
+void ScanPipeline::Scan(const char* path, std::vector<CoinResult>& results) {
+    // Alpha changes the gray levels, which the colors don't carry: such files take the path
+    // of scanImage that reads them. A request may reuse the path of the last one with new
+    // bytes, which the file name alone doesn't tell the reader.
+    m_Reader->SetFileName(path);
+    m_Reader->Modified();
+    m_Reader->UpdateOutputInformation();
+    if(hasAlphaChannel(m_Reader->GetImageIO()->GetNumberOfComponents())) {
+        ScanOptions options = m_Options;
+        options.cache = NULL;
+        scanImage(path, options, results);
+        return;
+    }
+
+    imageRecordBegin(path);
+
+    StageProbe readStage("read", NULL);
+    m_Reader->Update();
+    ImageColorType::Pointer imageColor = m_Reader->GetOutput();
+    readStage.Done(imageColor->GetLargestPossibleRegion().GetNumberOfPixels());
+
+    // Gray conversion and threshold in one pass, into the mask buffer of the last image
+    StageProbe thresholdStage("color threshold", NULL);
+    ImageColorType::RegionType region = imageColor->GetLargestPossibleRegion();
+    if(m_Mask->GetBufferPointer() == NULL || m_Mask->GetBufferedRegion() != region) {
+        m_Mask->CopyInformation(imageColor);
+        m_Mask->SetRegions(region);
+        m_Mask->Allocate();
+    }
+    ImageType::SizeType size = region.GetSize();
+    thresholdMask(reinterpret_cast<const unsigned char*>(imageColor->GetBufferPointer()), size[0] * sizeof(RGBPixelType), size[0], size[1], THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0, m_Mask->GetBufferPointer());
+    m_Mask->Modified();
+    thresholdStage.Done(region.GetNumberOfPixels());
+
+    ImageType::Pointer closedImage;
+    if(m_Closing.IsNotNull()) {
+        StageProbe closingStage("closing itk", NULL);
+        m_Closing->Update();
+        closedImage = m_Closing->GetOutput();
+        closingStage.Done(region.GetNumberOfPixels());
+    } else {
+        StageProbe closingStage("closing fast", NULL);
+        if(m_Closed->GetBufferPointer() == NULL || m_Closed->GetBufferedRegion() != region) {
+            m_Closed->CopyInformation(m_Mask);
+            m_Closed->SetRegions(region);
+            m_Closed->Allocate();
+        }
+        fastBinaryClosing(m_Mask->GetBufferPointer(), m_Closed->GetBufferPointer(), size[0], size[1], CLOSING_RADIUS, itk::NumericTraits<ImageType::PixelType>::max());
+        closedImage = m_Closed;
+        closingStage.Done(region.GetNumberOfPixels());
+    }
+
+    // Coins are the background of the closed image
+    std::vector<RegionStats> regions;
+    std::vector<unsigned int> numbers;
+    getCoinRegions(closedImage, imageColor, imageColor->GetBufferedRegion().GetIndex(), 0, regions, numbers);
+    size_t firstResult = results.size();
+    StageProbe stage("classification", NULL);
+    for(size_t i = 0; i < regions.size(); i++) {
+        classifyRegion(regions[i], numbers[i], results);
+    }
+    stage.Done(0, results.size() - firstResult);
+
+    imageRecordEnd();
+}
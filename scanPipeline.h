@@ -0,0 +1,30 @@
+#ifndef SCAN_PIPELINE_H
+#define SCAN_PIPELINE_H
+
+/* INCLUDES */
+
+#include "coinPipeline.h"
+
+/* Scan pipeline kept between images: the reader and closing filters, the closing structuring
+   element and the mask and closed buffers are built once and reused, so a thread scanning many
+   images of the same size only decodes and computes. Threshold and closing run as in a full
+   scan, the gray conversion and threshold fused in one pass; the closed image is labeled with
+   foreground 0 instead of being inverted. Files with an alpha channel are handed to scanImage.
+   One pipeline must only be used by one thread at a time. */
+class ScanPipeline {
+public:
+    ScanPipeline(const ScanOptions& options);
+
+    /* Scan an image file and append the detected coins to results. Throws
+       itk::ExceptionObject if the file can't be read. */
+    void Scan(const char* path, std::vector<CoinResult>& results);
+
+private:
+    ScanOptions m_Options;
+    ReaderColorType::Pointer m_Reader;
+    ImageType::Pointer m_Mask;                                      // Threshold mask
+    BinaryMorphologicalClosingImageFilterType::Pointer m_Closing;   // ITK closing engine only
+    ImageType::Pointer m_Closed;                                    // Fast closing output
+};
+
+#endif
@@ -0,0 +1,254 @@
+/* INCLUDES */
+
+#include "coinScanner.h"
+#include "instrumentation.h"
+#include "resultCache.h"
+#include "scanPipeline.h"
+#include "scanSocket.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkTimeProbe.h"
+#include <itksys/SystemTools.hxx>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* Largest encoded image accepted by a DATA request */
+#define SERVER_MAX_DATA (256L * 1024 * 1024)
+
+/* Connections silent for this long are closed, so idle clients don't hold a worker */
+#define SERVER_IDLE_SECONDS 30
+
+/* Shared state of the server workers */
+struct ServerState {
+    int listener;
+    const ScanOptions* options;
+    std::string dataDirectory;          // Private directory of the DATA request files
+    bool stopping;                      // Set by SHUTDOWN, workers stop accepting
+    unsigned long requests;
+    unsigned long failed;
+    itk::SimpleFastMutexLock lock;      // Protects stopping, requests and failed
+};
+
+/* @FUNCTIONS    */
+
+/* Scan one request of a connection and build its record */
+static std::string scanRequest(ServerState* state, ScanPipeline& pipeline, const std::string& label, const std::string& path) {
+    std::vector<CoinResult> results;
+    std::string error;
+    itk::TimeProbe time;
+    time.Start();
+    try {
+        // The warm pipeline only covers the plain full scan, its buffers live between requests.
+        // Other scans go through scanImage, which looks the cache up itself.
+        ResultCache* cache = state->options->cache;
+        CacheKey cacheKey;
+        if(state->options->pyramidFactor > 1 || state->options->tileSize > 0 || state->options->lowMemory) {
+            scanImage(path.c_str(), *state->options, results);
+        } else if(cache == NULL || !cache->Lookup(path.c_str(), *state->options, cacheKey, results)) {
+            pipeline.Scan(path.c_str(), results);
+            if(cache != NULL) {
+                cache->Store(cacheKey, results);
+            }
+        }
+    } catch(itk::ExceptionObject& e) {
+        error = e.GetDescription();
+    } catch(std::exception& e) {
+        error = e.what();
+    }
+    time.Stop();
+
+    state->lock.Lock();
+    state->requests++;
+    if(!error.empty()) {
+        state->failed++;
+    }
+    state->lock.Unlock();
+    return formatScanRecord(label, time.GetTotal(), results, error.empty() ? NULL : error.c_str());
+}
+
+/* Write the bytes of a DATA request to a new file only this process can open. False if the
+   file exists or can't be written. */
+static bool writeDataFile(const std::string& path, const std::vector<char>& data) {
+    int file = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if(file < 0) {
+        return false;
+    }
+    size_t written = 0;
+    while(written < data.size()) {
+        ssize_t count = write(file, &data[written], data.size() - written);
+        if(count < 0 && errno == EINTR) {
+            continue;
+        }
+        if(count <= 0) {
+            break;
+        }
+        written += count;
+    }
+    return close(file) == 0 && written == data.size();
+}
+
+/* Serve the requests of one connection until it is closed or idle. Returns false after SHUTDOWN.
+   'dataRequests' numbers the DATA files of the worker. */
+static bool serveConnection(ServerState* state, ScanPipeline& pipeline, int connection, const std::string& dataPath, unsigned long& dataRequests) {
+    SocketReader reader(connection);
+    std::string line;
+    std::vector<char> data;
+    while(reader.ReadLine(line)) {
+        std::string record;
+        if(line.compare(0, 5, "SCAN ") == 0) {
+            record = scanRequest(state, pipeline, line.substr(5), line.substr(5));
+        } else if(line.compare(0, 5, "DATA ") == 0) {
+            // The decoders read files, so the bytes go through a file of this worker
+            char extension[32];
+            long size;
+            if(sscanf(line.c_str() + 5, "%31s %ld", extension, &size) != 2 || size < 0 || size > SERVER_MAX_DATA || !isImageFile(std::string("data") + extension)) {
+                record = formatScanRecord("data", 0, std::vector<CoinResult>(), "invalid DATA request");
+                writeAll(connection, record.data(), record.size());
+                break;
+            }
+            data.resize(size);
+            if(size > 0 && !reader.Read(&data[0], size)) {
+                break;
+            }
+            // Every request gets a file of its own, so nothing keyed by path sees the last one
+            char name[32];
+            snprintf(name, sizeof(name), "-%lu", dataRequests++);
+            std::string path = dataPath + name + extension;
+            if(writeDataFile(path, data)) {
+                record = scanRequest(state, pipeline, "data", path);
+            } else {
+                record = formatScanRecord("data", 0, std::vector<CoinResult>(), "could not write DATA request");
+            }
+            unlink(path.c_str());
+        } else if(line == "SHUTDOWN") {
+            state->lock.Lock();
+            state->stopping = true;
+            state->lock.Unlock();
+            // Wakes up the workers blocked in accept()
+            shutdown(state->listener, SHUT_RDWR);
+            record = "{\"status\": \"shutdown\"}\n";
+            writeAll(connection, record.data(), record.size());
+            return false;
+        } else if(line.empty()) {
+            continue;
+        } else {
+            record = formatScanRecord("", 0, std::vector<CoinResult>(), ("unknown request: " + line).c_str());
+        }
+        if(!writeAll(connection, record.data(), record.size())) {
+            break;
+        }
+    }
+    return true;
+}
+
+/* Worker thread: accept connections and serve them with this thread's pipeline */
+static ITK_THREAD_RETURN_TYPE serverWorker(void* arg) {
+    itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct*) arg;
+    ServerState* state = (ServerState*) info->UserData;
+
+    // Filters, structuring element and buffers live as long as the worker
+    ScanPipeline pipeline(*state->options);
+    char name[32];
+    snprintf(name, sizeof(name), "/worker-%u", info->ThreadID);
+    std::string dataPath = state->dataDirectory + name;
+    unsigned long dataRequests = 0;
+
+    while(true) {
+        int connection = accept(state->listener, NULL, NULL);
+        state->lock.Lock();
+        bool stopping = state->stopping;
+        state->lock.Unlock();
+        if(connection < 0) {
+            if(errno == EINTR && !stopping) {
+                continue;
+            }
+            break;
+        }
+        if(stopping) {
+            close(connection);
+            break;
+        }
+        // Reads and writes give up after the idle timeout, which ends the connection
+        struct timeval timeout;
+        timeout.tv_sec = SERVER_IDLE_SECONDS;
+        timeout.tv_usec = 0;
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        bool running = serveConnection(state, pipeline, connection, dataPath, dataRequests);
+        close(connection);
+        if(!running) {
+            break;
+        }
+    }
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+int runServer(const char* socketPath, const ScanOptions& options, unsigned int threads) {
+    ServerState state;
+    std::string error;
+    state.listener = listenUnixSocket(socketPath, error);
+    if(state.listener < 0) {
+        fprintf(stderr, "Could not listen on socket: %s\n", error.c_str());
+        return 1;
+    }
+    state.stopping = false;
+    state.requests = 0;
+    state.failed = 0;
+
+    // DATA request files go to a directory only this process can use, not to guessable paths
+    const char* temporary = getenv("TMPDIR");
+    std::string dataTemplate = std::string(temporary != NULL ? temporary : "/tmp") + "/coinScanner-XXXXXX";
+    std::vector<char> dataDirectory(dataTemplate.begin(), dataTemplate.end());
+    dataDirectory.push_back('\0');
+    if(mkdtemp(&dataDirectory[0]) == NULL) {
+        fprintf(stderr, "Could not create data directory: %s\n", strerror(errno));
+        close(state.listener);
+        unlink(socketPath);
+        return 1;
+    }
+    state.dataDirectory = &dataDirectory[0];
+
+    // Parallelism is across requests, as in batch mode
+    if(threads == 0) {
+        threads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+    threads = std::min<unsigned int>(threads, itk::MultiThreader::GetGlobalMaximumNumberOfThreads());
+    // Both settings are process wide, the caller gets them back
+    itk::ThreadIdType defaultThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    int progressShown = showProgress;
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads(1);
+    showProgress = 0;
+
+    ScanOptions serverOptions = options;
+    serverOptions.outputImages = 0;
+    state.options = &serverOptions;
+
+    fprintf(stderr, "> Serving on %s - %u workers\n", socketPath, threads);
+    itk::TimeProbe time;
+    time.Start();
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads(threads);
+    threader->SetSingleMethod(serverWorker, &state);
+    threader->SingleMethodExecute();
+    time.Stop();
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads(defaultThreads);
+    showProgress = progressShown;
+
+    close(state.listener);
+    unlink(socketPath);
+    rmdir(state.dataDirectory.c_str());
+    fprintf(stderr, "> Server: %lu requests - %lu failed - %.3fs - Peak memory: %ld KB\n",
+        state.requests, state.failed, time.GetTotal(), peakResidentMemory());
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+/* INCLUDES */
+
+#include "scanSocket.h"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Connections waiting to be accepted */
+#define SOCKET_BACKLOG 64
+
+/* @FUNCTIONS    */
+
+SocketReader::SocketReader(int socket) {
+    m_Socket = socket;
+    m_Start = 0;
+    m_End = 0;
+}
+
+/* Read more bytes into the empty buffer */
+bool SocketReader::Fill() {
+    while(true) {
+        ssize_t count = read(m_Socket, m_Buffer, sizeof(m_Buffer));
+        if(count > 0) {
+            m_Start = 0;
+            m_End = count;
+            return true;
+        }
+        if(count == 0 || errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool SocketReader::ReadLine(std::string& line) {
+    line.clear();
+    while(true) {
+        if(m_Start == m_End && !Fill()) {
+            return !line.empty();
+        }
+        char* newline = (char*) memchr(m_Buffer + m_Start, '\n', m_End - m_Start);
+        if(newline != NULL) {
+            line.append(m_Buffer + m_Start, newline - (m_Buffer + m_Start));
+            m_Start = newline - m_Buffer + 1;
+            if(!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            return true;
+        }
+        line.append(m_Buffer + m_Start, m_End - m_Start);
+        m_Start = m_End;
+    }
+}
+
+bool SocketReader::Read(char* data, size_t size) {
+    while(size > 0) {
+        if(m_Start == m_End && !Fill()) {
+            return false;
+        }
+        size_t count = std::min(size, m_End - m_Start);
+        memcpy(data, m_Buffer + m_Start, count);
+        m_Start += count;
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool writeAll(int socket, const char* data, size_t size) {
+    while(size > 0) {
+        ssize_t count = send(socket, data, size, MSG_NOSIGNAL);
+        if(count < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+/* Socket address of a socket file */
+static bool socketAddress(const char* path, struct sockaddr_un& address, std::string& error) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path)) {
+        error = std::string("socket path too long: ") + path;
+        return false;
+    }
+    strcpy(address.sun_path, path);
+    return true;
+}
+
+int listenUnixSocket(const char* path, std::string& error) {
+    struct sockaddr_un address;
+    if(!socketAddress(path, address, error)) {
+        return -1;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0) {
+        error = strerror(errno);
+        return -1;
+    }
+    // Only a socket left by an earlier server is replaced, never a file that happens to be there
+    struct stat status;
+    if(lstat(path, &status) == 0) {
+        if(!S_ISSOCK(status.st_mode)) {
+            error = std::string(path) + ": exists and is not a socket";
+            close(listener);
+            return -1;
+        }
+        unlink(path);
+    }
+    if(bind(listener, (struct sockaddr*) &address, sizeof(address)) < 0 || listen(listener, SOCKET_BACKLOG) < 0) {
+        error = std::string(path) + ": " + strerror(errno);
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+int connectUnixSocket(const char* path, std::string& error) {
+    struct sockaddr_un address;
+    if(!socketAddress(path, address, error)) {
+        return -1;
+    }
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(connection < 0) {
+        error = strerror(errno);
+        return -1;
+    }
+    if(connect(connection, (struct sockaddr*) &address, sizeof(address)) < 0) {
+        error = std::string(path) + ": " + strerror(errno);
+        close(connection);
+        return -1;
+    }
+    return connection;
+}
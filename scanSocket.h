@@ -0,0 +1,52 @@
+#ifndef SCAN_SOCKET_H
+#define SCAN_SOCKET_H
+
+/* INCLUDES */
+
+#include <string>
+#include <stddef.h>
+
+/* Requests of the scanning server, one per line on a Unix domain socket:
+
+       SCAN <path>                  Scan an image file readable by the server
+       DATA <extension> <size>      Scan the encoded image of <size> bytes that follows the line,
+                                    <extension> (".png", ".jpg", ...) tells its format
+       SHUTDOWN                     Stop the server once the open connections are closed
+
+   SCAN and DATA are answered with one line, the JSON record of the image as in batch mode.
+   A connection may send any number of requests, and is closed by the client, or by the server
+   once it has been idle for a while. */
+
+/* Buffered reads from a socket */
+class SocketReader {
+public:
+    SocketReader(int socket);
+
+    /* Next line, without the newline. False at the end of the stream. */
+    bool ReadLine(std::string& line);
+
+    /* Exactly 'size' bytes. False at the end of the stream. */
+    bool Read(char* data, size_t size);
+
+private:
+    bool Fill();
+
+    int m_Socket;
+    char m_Buffer[65536];
+    size_t m_Start;     // Unread bytes of m_Buffer
+    size_t m_End;
+};
+
+/* @FUNCTIONS    */
+
+/* Write every byte, retrying short writes. False if the connection is gone. */
+bool writeAll(int socket, const char* data, size_t size);
+
+/* Listen on a new socket file, replacing a stale socket. Any other file at 'path' is an error.
+   Returns the socket, or -1 with 'error' set. */
+int listenUnixSocket(const char* path, std::string& error);
+
+/* Connect to a listening socket file. Returns the socket, or -1 with 'error' set. */
+int connectUnixSocket(const char* path, std::string& error);
+
+#endif
@@ -0,0 +1,177 @@
+/* INCLUDES */
+
+#include "thresholdMask.h"
+#include <stddef.h>
+
+/* Vector kernels, on x86 compilers that can target AVX2 per function */
+#if defined(__GNUC__) && defined(__SSE2__)
+#define MASK_SSE2 1
+#include <emmintrin.h>
+#if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define MASK_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+/* Gray weights, scaled by 10000 */
+#define WEIGHT_R 2125
+#define WEIGHT_G 7154
+#define WEIGHT_B 721
+
+/* Pixels past the last one a vector iteration uses that its loads also read: the last 16 byte
+   load of a group of pixels starts 12 bytes before its end */
+#define MASK_OVERREAD 2
+
+/* Kernel over whole rows */
+typedef void (*MaskKernel)(const unsigned char* rgb, long rgbStride, int width, int height, int low, int high, unsigned char inside, unsigned char outside, unsigned char* mask);
+
+/* @FUNCTIONS    */
+
+/* Pixels of a row from 'x' on, one at a time */
+static inline void maskScalar(const unsigned char* in, int x, int width, int low, int high, unsigned char inside, unsigned char outside, unsigned char* out) {
+    for(in += 3 * x; x < width; x++, in += 3) {
+        int sum = WEIGHT_R * in[0] + WEIGHT_G * in[1] + WEIGHT_B * in[2];
+        out[x] = sum >= low && sum <= high ? inside : outside;
+    }
+}
+
+#ifndef MASK_SSE2
+static void maskRowsScalar(const unsigned char* rgb, long rgbStride, int width, int height, int low, int high, unsigned char inside, unsigned char outside, unsigned char* mask) {
+    for(int y = 0; y < height; y++) {
+        maskScalar(rgb + y * rgbStride, 0, width, low, high, inside, outside, mask + (long) y * width);
+    }
+}
+#endif
+
+#ifdef MASK_SSE2
+/* Weighted sums of 4 pixels. The pixels are spread to one 32 bit lane each, as R G B 0, by
+   byte shifts, then widened to 16 bits and weighted in (R, G) and (B, 0) pairs by madd. */
+static inline __m128i sumSse2(const unsigned char* in, __m128i lane0, __m128i lane1, __m128i lane2, __m128i lane3, __m128i weights) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    __m128i pixels = _mm_or_si128(_mm_or_si128(_mm_and_si128(x, lane0), _mm_and_si128(_mm_slli_si128(x, 1), lane1)),
+        _mm_or_si128(_mm_and_si128(_mm_slli_si128(x, 2), lane2), _mm_and_si128(_mm_slli_si128(x, 3), lane3)));
+    __m128i zero = _mm_setzero_si128();
+    __m128i first = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+    __m128i second = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+    // first is RG0 B0 RG1 B1, second RG2 B2 RG3 B3
+    __m128 evens = _mm_shuffle_ps(_mm_castsi128_ps(first), _mm_castsi128_ps(second), _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 odds = _mm_shuffle_ps(_mm_castsi128_ps(first), _mm_castsi128_ps(second), _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_epi32(_mm_castps_si128(evens), _mm_castps_si128(odds));
+}
+
+/* 0xFFFFFFFF lanes for the sums within low - 1 < sum < high + 1 */
+static inline __m128i insideSse2(__m128i sum, __m128i below, __m128i above) {
+    return _mm_and_si128(_mm_cmpgt_epi32(sum, below), _mm_cmpgt_epi32(above, sum));
+}
+
+static void maskRowsSse2(const unsigned char* rgb, long rgbStride, int width, int height, int low, int high, unsigned char inside, unsigned char outside, unsigned char* mask) {
+    const __m128i lane0 = _mm_setr_epi32(0x00FFFFFF, 0, 0, 0);
+    const __m128i lane1 = _mm_setr_epi32(0, 0x00FFFFFF, 0, 0);
+    const __m128i lane2 = _mm_setr_epi32(0, 0, 0x00FFFFFF, 0);
+    const __m128i lane3 = _mm_setr_epi32(0, 0, 0, 0x00FFFFFF);
+    const __m128i weights = _mm_setr_epi16(WEIGHT_R, WEIGHT_G, WEIGHT_B, 0, WEIGHT_R, WEIGHT_G, WEIGHT_B, 0);
+    const __m128i below = _mm_set1_epi32(low - 1);
+    const __m128i above = _mm_set1_epi32(high + 1);
+    const __m128i insideValue = _mm_set1_epi8((char) inside);
+    const __m128i outsideValue = _mm_set1_epi8((char) outside);
+
+    for(int y = 0; y < height; y++) {
+        const unsigned char* in = rgb + y * rgbStride;
+        unsigned char* out = mask + (long) y * width;
+        int x = 0;
+        for(; x + 16 + MASK_OVERREAD <= width; x += 16) {
+            const unsigned char* pixels = in + 3 * x;
+            __m128i first = _mm_packs_epi32(insideSse2(sumSse2(pixels, lane0, lane1, lane2, lane3, weights), below, above),
+                insideSse2(sumSse2(pixels + 12, lane0, lane1, lane2, lane3, weights), below, above));
+            __m128i second = _mm_packs_epi32(insideSse2(sumSse2(pixels + 24, lane0, lane1, lane2, lane3, weights), below, above),
+                insideSse2(sumSse2(pixels + 36, lane0, lane1, lane2, lane3, weights), below, above));
+            __m128i selected = _mm_packs_epi16(first, second);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_or_si128(_mm_and_si128(selected, insideValue), _mm_andnot_si128(selected, outsideValue)));
+        }
+        maskScalar(in, x, width, low, high, inside, outside, out);
+    }
+}
+#endif
+
+#ifdef MASK_AVX2
+/* Weighted sums of 8 pixels, 4 per 128 bit lane. Each lane is shuffled into (R, G) and (B, 0)
+   16 bit pairs, weighted by madd. */
+__attribute__((target("avx2")))
+static inline __m256i sumAvx2(const unsigned char* in, __m256i redGreen, __m256i blue, __m256i weightsRedGreen, __m256i weightsBlue) {
+    __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 12)), 1);
+    return _mm256_add_epi32(_mm256_madd_epi16(_mm256_shuffle_epi8(x, redGreen), weightsRedGreen), _mm256_madd_epi16(_mm256_shuffle_epi8(x, blue), weightsBlue));
+}
+
+__attribute__((target("avx2")))
+static void maskRowsAvx2(const unsigned char* rgb, long rgbStride, int width, int height, int low, int high, unsigned char inside, unsigned char outside, unsigned char* mask) {
+    const __m256i redGreen = _mm256_setr_epi8(0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1,
+        0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1);
+    const __m256i blue = _mm256_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1,
+        2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+    const __m256i weightsRedGreen = _mm256_set1_epi32((WEIGHT_G << 16) | WEIGHT_R);
+    const __m256i weightsBlue = _mm256_set1_epi32(WEIGHT_B);
+    const __m256i below = _mm256_set1_epi32(low - 1);
+    const __m256i above = _mm256_set1_epi32(high + 1);
+    const __m128i insideValue = _mm_set1_epi8((char) inside);
+    const __m128i outsideValue = _mm_set1_epi8((char) outside);
+
+    for(int y = 0; y < height; y++) {
+        const unsigned char* in = rgb + y * rgbStride;
+        unsigned char* out = mask + (long) y * width;
+        int x = 0;
+        for(; x + 16 + MASK_OVERREAD <= width; x += 16) {
+            __m256i first = sumAvx2(in + 3 * x, redGreen, blue, weightsRedGreen, weightsBlue);
+            __m256i second = sumAvx2(in + 3 * x + 24, redGreen, blue, weightsRedGreen, weightsBlue);
+            first = _mm256_and_si256(_mm256_cmpgt_epi32(first, below), _mm256_cmpgt_epi32(above, first));
+            second = _mm256_and_si256(_mm256_cmpgt_epi32(second, below), _mm256_cmpgt_epi32(above, second));
+            // Packing works per lane: the bytes come out as pixels 0-3 8-11 in the low lane
+            // and 4-7 12-15 in the high one, interleaved back by 32 bit groups
+            __m256i words = _mm256_packs_epi32(first, second);
+            __m256i bytes = _mm256_packs_epi16(words, words);
+            __m128i selected = _mm_unpacklo_epi32(_mm256_castsi256_si128(bytes), _mm256_extracti128_si256(bytes, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_or_si128(_mm_and_si128(selected, insideValue), _mm_andnot_si128(selected, outsideValue)));
+        }
+        maskScalar(in, x, width, low, high, inside, outside, out);
+    }
+}
+#endif
+
+/* Best kernel of this processor, picked on the first call */
+static MaskKernel selectKernel(const char** name) {
+#ifdef MASK_AVX2
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return maskRowsAvx2;
+    }
+#endif
+#ifdef MASK_SSE2
+    *name = "sse2";
+    return maskRowsSse2;
+#else
+    *name = "scalar";
+    return maskRowsScalar;
+#endif
+}
+
+static const char* kernelName = NULL;
+static MaskKernel kernel = NULL;
+
+const char* thresholdMaskKernel() {
+    if(kernel == NULL) {
+        kernel = selectKernel(&kernelName);
+    }
+    return kernelName;
+}
+
+void thresholdMask(const unsigned char* rgb, long rgbStride, int width, int height, int lower, int upper, unsigned char inside, unsigned char outside, unsigned char* mask) {
+    if(width <= 0 || height <= 0) {
+        return;
+    }
+    thresholdMaskKernel();
+    // Gray levels are 0 to 255, clamping keeps the scaled bounds in range
+    lower = lower < 0 ? 0 : lower;
+    upper = upper > 255 ? 255 : upper;
+    kernel(rgb, rgbStride, width, height, lower * 10000, upper * 10000 + 9999, inside, outside, mask);
+}
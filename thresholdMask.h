@@ -0,0 +1,17 @@
+#ifndef THRESHOLD_MASK_H
+#define THRESHOLD_MASK_H
+
+/* Gray conversion and binary threshold fused in one pass over interleaved 8 bit RGB rows.
+   A pixel is set to 'inside' when its gray level (2125 R + 7154 G + 721 B) / 10000 is within
+   'lower' to 'upper', and to 'outside' otherwise, so the mask is identical to the gray
+   conversion followed by itk::BinaryThresholdImageFilter. The level is never divided: the
+   weighted sum is compared to lower * 10000 and upper * 10000 + 9999 instead.
+
+   Rows of 'rgb' are 'rgbStride' bytes apart, rows of 'mask' are 'width' bytes. The AVX2 or
+   SSE2 kernel is picked when the processor has it, with the same results as the scalar one. */
+void thresholdMask(const unsigned char* rgb, long rgbStride, int width, int height, int lower, int upper, unsigned char inside, unsigned char outside, unsigned char* mask);
+
+/* Name of the kernel thresholdMask runs on this processor: "avx2", "sse2" or "scalar" */
+const char* thresholdMaskKernel();
+
+#endif
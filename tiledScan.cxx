@@ -0,0 +1,271 @@
+/* INCLUDES */
+
+#include "coinPipeline.h"
+#include "instrumentation.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+/* Objects of one tile core, with the labels on its edges to merge them with the neighbours */
+struct TileResult {
+    std::vector<RegionAccumulator> objects;
+    RegionEdges edges;
+};
+
+/* Shared state of the tile workers */
+struct TileState {
+    const char* path;
+    const ScanOptions* options;
+    int radius;
+    ImageColorType::RegionType imageRegion;
+    unsigned int tileSize;
+    unsigned int tilesX;
+    unsigned int tilesY;
+    std::vector<TileResult> tiles;
+    size_t next;                        // Next tile to be processed
+    std::string error;                  // First failure, stops the workers
+    itk::SimpleFastMutexLock lock;      // Protects next and error
+};
+
+/* @FUNCTIONS    */
+
+/* Copy a region of a color image into a new image indexed from 0 */
+static ImageColorType::Pointer copyTile(ImageColorType* source, const ImageColorType::RegionType& region) {
+    ImageColorType::RegionType tileRegion;
+    tileRegion.SetSize(region.GetSize());
+    ImageColorType::Pointer tile = ImageColorType::New();
+    tile->SetRegions(tileRegion);
+    tile->Allocate();
+
+    long sourceStride = source->GetBufferedRegion().GetSize()[0];
+    long width = region.GetSize()[0];
+    const RGBPixelType* from = source->GetBufferPointer() + source->ComputeOffset(region.GetIndex());
+    RGBPixelType* to = tile->GetBufferPointer();
+    for(unsigned long y = 0; y < region.GetSize()[1]; y++) {
+        memcpy(to + y * width, from + y * sourceStride, width * sizeof(RGBPixelType));
+    }
+    return tile;
+}
+
+/* Segment and label the core of one tile. The tile is read with a halo of twice the closing
+   radius plus one pixel around its core, clipped to the image: a closed pixel depends on inputs
+   at most twice the radius away, so the mask of the core and of the pixels around it, which the
+   perimeter looks at, is the one of a full scan. */
+static void processTile(TileState* state, unsigned int tile) {
+    const ImageColorType::RegionType& imageRegion = state->imageRegion;
+    long halo = 2 * state->radius + 1;
+    long coreStart[2];
+    long coreSize[2];
+    ImageColorType::IndexType haloIndex;
+    ImageColorType::SizeType haloSize;
+    for(unsigned int d = 0; d < 2; d++) {
+        long imageStart = imageRegion.GetIndex()[d];
+        long imageEnd = imageStart + imageRegion.GetSize()[d];
+        long position = d == 0 ? tile % state->tilesX : tile / state->tilesX;
+        coreStart[d] = imageStart + position * state->tileSize;
+        coreSize[d] = std::min<long>(state->tileSize, imageEnd - coreStart[d]);
+        haloIndex[d] = std::max(imageStart, coreStart[d] - halo);
+        haloSize[d] = std::min(imageEnd, coreStart[d] + coreSize[d] + halo) - haloIndex[d];
+    }
+    ImageColorType::RegionType haloRegion(haloIndex, haloSize);
+
+    // Only the tile and its halo are read
+    ReaderColorType::Pointer reader = ReaderColorType::New();
+    reader->SetFileName(state->path);
+    reader->UpdateOutputInformation();
+    reader->GetOutput()->SetRequestedRegion(haloRegion);
+    reader->Update();
+    ImageColorType::Pointer colorTile = copyTile(reader->GetOutput(), haloRegion);
+    reader = NULL;
+
+    // Coins are the background of the closed mask, there is no gray image nor invert pass
+    ImageType::Pointer mask = applyColorThreshold(colorTile, THRESHOLD_LOWER, THRESHOLD_UPPER, 255, 0);
+    if(state->options->lowMemory) {
+        mask = applyClosingInPlace(mask, state->radius, *state->options);
+    } else {
+        mask = applyClosing(mask, state->radius, state->options->closingEngine);
+    }
+
+    // Label the core, looking one pixel into the halo for the perimeter
+    long offsetX = coreStart[0] - haloIndex[0];
+    long offsetY = coreStart[1] - haloIndex[1];
+    RegionWindow window;
+    window.mask = mask->GetBufferPointer() + offsetY * haloSize[0] + offsetX;
+    window.maskStride = haloSize[0];
+    window.width = coreSize[0];
+    window.height = coreSize[1];
+    window.context[0] = std::min(offsetX, 1L);
+    window.context[1] = std::min(offsetY, 1L);
+    window.context[2] = std::min<long>(haloSize[0] - offsetX - coreSize[0], 1);
+    window.context[3] = std::min<long>(haloSize[1] - offsetY - coreSize[1], 1);
+    window.foreground = 0;
+    window.rgb = reinterpret_cast<const unsigned char*>(colorTile->GetBufferPointer() + offsetY * haloSize[0] + offsetX);
+    window.rgbStride = haloSize[0] * sizeof(RGBPixelType);
+    window.originX = coreStart[0] - imageRegion.GetIndex()[0];
+    window.originY = coreStart[1] - imageRegion.GetIndex()[1];
+
+    TileResult& result = state->tiles[tile];
+    labelRegionWindow(window, result.objects, &result.edges);
+}
+
+/* Worker thread: take the next tile and process it until none are left or one failed */
+static ITK_THREAD_RETURN_TYPE tileWorker(void* arg) {
+    itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct*) arg;
+    TileState* state = (TileState*) info->UserData;
+
+    // Parallelism is across tiles: the filters of a tile are single threaded, so the workers
+    // don't oversubscribe the cores, and the per-tile progress lines and stages are skipped
+    setScanWorker(true);
+    ImageRecord* record = imageRecordSuspend();
+    while(true) {
+        state->lock.Lock();
+        if(state->next >= state->tiles.size() || !state->error.empty()) {
+            state->lock.Unlock();
+            break;
+        }
+        unsigned int tile = state->next++;
+        state->lock.Unlock();
+
+        // Every pipeline object is created by this thread for this tile
+        std::string error;
+        try {
+            processTile(state, tile);
+        } catch(itk::ExceptionObject& e) {
+            error = e.GetDescription();
+        } catch(std::exception& e) {
+            error = e.what();
+        }
+
+        if(!error.empty()) {
+            state->lock.Lock();
+            if(state->error.empty()) {
+                state->error = error;
+            }
+            state->lock.Unlock();
+        }
+    }
+    // The first worker runs on the calling thread, whose image record goes on
+    setScanWorker(false);
+    imageRecordResume(record);
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+/* Root of an object, halving the path on the way */
+static unsigned int findObject(std::vector<unsigned int>& parent, unsigned int object) {
+    while(parent[object] != object) {
+        parent[object] = parent[parent[object]];
+        object = parent[object];
+    }
+    return object;
+}
+
+/* Join the objects on both sides of a tile seam, 'a' and 'b' are the edge labels of each side */
+static void joinSeam(std::vector<unsigned int>& parent, const std::vector<unsigned int>& a, unsigned int offsetA, const std::vector<unsigned int>& b, unsigned int offsetB) {
+    for(size_t i = 0; i < a.size(); i++) {
+        if(a[i] == 0 || b[i] == 0) {
+            continue;
+        }
+        unsigned int rootA = findObject(parent, offsetA + a[i] - 1);
+        unsigned int rootB = findObject(parent, offsetB + b[i] - 1);
+        if(rootA != rootB) {
+            parent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+        }
+    }
+}
+
+/* Raster order of the first pixel, which is the object order of a full scan */
+static bool firstPixelBefore(const RegionAccumulator& a, const RegionAccumulator& b) {
+    return a.minY < b.minY || (a.minY == b.minY && a.firstX < b.firstX);
+}
+
+/* Scan an image in tiles of 'tileSize' pixels processed in parallel */
+void scanTiled(const char* path, int radius, const ScanOptions& options, std::vector<CoinResult>& results) {
+    TileState state;
+    state.path = path;
+    state.options = &options;
+    state.radius = radius;
+    state.tileSize = options.tileSize;
+    state.next = 0;
+
+    // Tiles are read by region, a format that can only be decoded whole would not bound memory
+    StageProbe readStage("read", (std::string("Reading file: ") + path).c_str());
+    ReaderColorType::Pointer reader = ReaderColorType::New();
+    reader->SetFileName(path);
+    reader->UpdateOutputInformation();
+    state.imageRegion = reader->GetOutput()->GetLargestPossibleRegion();
+    if(!reader->GetImageIO()->CanStreamRead()) {
+        std::string error = std::string(path) + ": the " + reader->GetImageIO()->GetNameOfClass() +
+            " format can't be read by region, tiled scans need one that can (MetaImage, NRRD)";
+        throw itk::ExceptionObject(__FILE__, __LINE__, error.c_str(), ITK_LOCATION);
+    }
+    reader = NULL;
+    readStage.Done(0);
+
+    state.tilesX = (state.imageRegion.GetSize()[0] + state.tileSize - 1) / state.tileSize;
+    state.tilesY = (state.imageRegion.GetSize()[1] + state.tileSize - 1) / state.tileSize;
+    state.tiles.resize(state.tilesX * state.tilesY);
+
+    // One worker per core, or a single one inside a batch or server worker
+    StageProbe tileStage("tiles", "Segmenting tiles");
+    unsigned int threads = std::min<size_t>(itk::MultiThreader::GetGlobalDefaultNumberOfThreads(), state.tiles.size());
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads(std::max(threads, 1u));
+    threader->SetSingleMethod(tileWorker, &state);
+    threader->SingleMethodExecute();
+
+    if(!state.error.empty()) {
+        throw itk::ExceptionObject(__FILE__, __LINE__, state.error.c_str(), ITK_LOCATION);
+    }
+
+    // Objects cut by the tile borders are joined across the seams of neighbouring tiles
+    std::vector<unsigned int> offsets(state.tiles.size() + 1, 0);
+    for(size_t t = 0; t < state.tiles.size(); t++) {
+        offsets[t + 1] = offsets[t] + state.tiles[t].objects.size();
+    }
+    std::vector<unsigned int> parent(offsets.back());
+    for(size_t i = 0; i < parent.size(); i++) {
+        parent[i] = i;
+    }
+    for(unsigned int y = 0; y < state.tilesY; y++) {
+        for(unsigned int x = 0; x < state.tilesX; x++) {
+            unsigned int t = y * state.tilesX + x;
+            if(x + 1 < state.tilesX) {
+                joinSeam(parent, state.tiles[t].edges.right, offsets[t], state.tiles[t + 1].edges.left, offsets[t + 1]);
+            }
+            if(y + 1 < state.tilesY) {
+                joinSeam(parent, state.tiles[t].edges.bottom, offsets[t], state.tiles[t + state.tilesX].edges.top, offsets[t + state.tilesX]);
+            }
+        }
+    }
+
+    std::vector<RegionAccumulator> objects;
+    std::vector<unsigned int> objectOf(parent.size(), 0);
+    for(size_t t = 0; t < state.tiles.size(); t++) {
+        for(size_t i = 0; i < state.tiles[t].objects.size(); i++) {
+            unsigned int object = offsets[t] + i;
+            unsigned int root = findObject(parent, object);
+            if(root == object) {
+                objects.push_back(state.tiles[t].objects[i]);
+                objectOf[object] = objects.size();
+            } else {
+                addRegionAccumulator(objects[objectOf[root] - 1], state.tiles[t].objects[i]);
+            }
+        }
+        state.tiles[t] = TileResult();
+    }
+    std::sort(objects.begin(), objects.end(), firstPixelBefore);
+    tileStage.Done(state.imageRegion.GetNumberOfPixels(), objects.size());
+
+    progress("> Results: \n");
+    size_t firstResult = results.size();
+    StageProbe stage("classification", NULL);
+    for(size_t i = 0; i < objects.size(); i++) {
+        classifyRegion(finishRegionStats(objects[i]), i+1, results);
+    }
+    stage.Done(0, results.size() - firstResult);
+}
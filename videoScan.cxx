@@ -0,0 +1,358 @@
+/* INCLUDES */
+
+#include "coinPipeline.h"
+#include "instrumentation.h"
+#include <itksys/SystemTools.hxx>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Frame differencing: a tile changed when more than VIDEO_CHANGED_PIXELS of its pixels moved
+   more than VIDEO_DIFF_THRESHOLD gray levels since they were last scanned */
+#define VIDEO_TILE              32
+#define VIDEO_DIFF_THRESHOLD    24
+#define VIDEO_CHANGED_PIXELS    16
+
+/* Coins of consecutive frames are the same coin when their type matches and their boxes are
+   at most this far apart */
+#define VIDEO_MATCH_DISTANCE    4
+
+/* Ordered frames, image files or a raw stream */
+struct FrameSource {
+    std::vector<std::string> files;
+    FILE* stream;
+    const VideoOptions* video;
+    std::vector<unsigned char> raw;     // One raw frame
+    unsigned int next;                  // Next frame number
+};
+
+/* @FUNCTIONS    */
+
+/* Open a directory, glob or list of frames, or a raw .rgb / .yuv stream */
+static bool openFrameSource(const char* source, const VideoOptions& video, FrameSource& frames) {
+    frames.stream = NULL;
+    frames.video = &video;
+    frames.next = 0;
+    if(video.format == FRAME_FILES) {
+        return collectBatchFiles(source, frames.files);
+    }
+    if(video.width == 0 || video.height == 0 || video.width % 2 || video.height % 2) {
+        fprintf(stderr, "Raw streams need an even --frame-size=WxH\n");
+        return false;
+    }
+    frames.stream = fopen(source, "rb");
+    size_t pixels = (size_t) video.width * video.height;
+    frames.raw.resize(video.format == FRAME_RGB ? pixels * 3 : pixels * 3 / 2);
+    return frames.stream != NULL;
+}
+
+/* Clamp a color component */
+static inline unsigned char clampComponent(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+/* Read the next frame, a null pointer at the end of the sequence */
+static ImageColorType::Pointer readFrame(FrameSource& frames, std::string& name) {
+    if(frames.stream == NULL) {
+        if(frames.next >= frames.files.size()) {
+            return NULL;
+        }
+        name = frames.files[frames.next++];
+        ReaderColorType::Pointer reader = readColorFromFile((char*) name.c_str());
+        ImageColorType::Pointer frame = reader->GetOutput();
+        frame->DisconnectPipeline();
+        return frame;
+    }
+
+    if(fread(&frames.raw[0], 1, frames.raw.size(), frames.stream) != frames.raw.size()) {
+        return NULL;
+    }
+    char number[16];
+    sprintf(number, "#%u", frames.next++);
+    name = number;
+
+    const VideoOptions& video = *frames.video;
+    ImageColorType::Pointer frame = ImageColorType::New();
+    ImageColorType::SizeType size;
+    size[0] = video.width;
+    size[1] = video.height;
+    frame->SetRegions(size);
+    frame->Allocate();
+    unsigned char* out = reinterpret_cast<unsigned char*>(frame->GetBufferPointer());
+    if(video.format == FRAME_RGB) {
+        memcpy(out, &frames.raw[0], frames.raw.size());
+        return frame;
+    }
+
+    // Planar YUV 4:2:0, BT.601 limited range
+    const unsigned char* luma = &frames.raw[0];
+    const unsigned char* u = luma + video.width * video.height;
+    const unsigned char* v = u + (video.width / 2) * (video.height / 2);
+    for(unsigned int y = 0; y < video.height; y++) {
+        for(unsigned int x = 0; x < video.width; x++) {
+            unsigned int chroma = (y / 2) * (video.width / 2) + x / 2;
+            int c = 298 * ((int) luma[y * video.width + x] - 16);
+            int d = (int) u[chroma] - 128;
+            int e = (int) v[chroma] - 128;
+            out[0] = clampComponent((c + 409 * e + 128) >> 8);
+            out[1] = clampComponent((c - 100 * d - 208 * e + 128) >> 8);
+            out[2] = clampComponent((c + 516 * d + 128) >> 8);
+            out += 3;
+        }
+    }
+    return frame;
+}
+
+/* Compare a frame with the reference, tile by tile. Changed tiles are copied into the
+   reference, and the bounding boxes of the groups of changed tiles, grown by 'margin' and
+   clipped to the frame, are merged until they don't overlap. Returns the changed pixels. */
+static unsigned long findChangedRegions(ImageType::Pointer reference, ImageType::Pointer image, long margin, std::vector<ImageType::RegionType>& regions) {
+    ImageType::RegionType imageRegion = image->GetBufferedRegion();
+    int width = imageRegion.GetSize()[0];
+    int height = imageRegion.GetSize()[1];
+    int tilesX = (width + VIDEO_TILE - 1) / VIDEO_TILE;
+    int tilesY = (height + VIDEO_TILE - 1) / VIDEO_TILE;
+    unsigned char* before = reference->GetBufferPointer();
+    const unsigned char* after = image->GetBufferPointer();
+
+    std::vector<unsigned char> changed(tilesX * tilesY, 0);
+    unsigned long changedPixels = 0;
+    for(int ty = 0; ty < tilesY; ty++) {
+        for(int tx = 0; tx < tilesX; tx++) {
+            int x0 = tx * VIDEO_TILE;
+            int y0 = ty * VIDEO_TILE;
+            int x1 = std::min(x0 + VIDEO_TILE, width);
+            int y1 = std::min(y0 + VIDEO_TILE, height);
+            int moved = 0;
+            for(int y = y0; y < y1; y++) {
+                for(int x = x0; x < x1; x++) {
+                    moved += abs((int) after[y * width + x] - (int) before[y * width + x]) > VIDEO_DIFF_THRESHOLD;
+                }
+            }
+            if(moved > VIDEO_CHANGED_PIXELS) {
+                changed[ty * tilesX + tx] = 255;
+                changedPixels += (x1 - x0) * (y1 - y0);
+                for(int y = y0; y < y1; y++) {
+                    memcpy(before + y * width + x0, after + y * width + x0, x1 - x0);
+                }
+            }
+        }
+    }
+
+    // Groups of touching tiles, in pixels and grown by the margin
+    std::vector<RegionStats> groups;
+    labelRegionStats(&changed[0], tilesX, tilesY, 255, NULL, 0, groups);
+    std::vector<long> boxes;
+    for(size_t i = 0; i < groups.size(); i++) {
+        boxes.push_back(std::max(0L, (long) groups[i].x * VIDEO_TILE - margin));
+        boxes.push_back(std::max(0L, (long) groups[i].y * VIDEO_TILE - margin));
+        boxes.push_back(std::min((long) width, (long) (groups[i].x + groups[i].width) * VIDEO_TILE + margin));
+        boxes.push_back(std::min((long) height, (long) (groups[i].y + groups[i].height) * VIDEO_TILE + margin));
+    }
+
+    // Merge overlapping boxes into their bounding box until none overlap
+    bool merged = true;
+    while(merged) {
+        merged = false;
+        for(size_t i = 0; i < boxes.size() && !merged; i += 4) {
+            for(size_t j = i + 4; j < boxes.size() && !merged; j += 4) {
+                if(boxes[i] < boxes[j + 2] && boxes[j] < boxes[i + 2] && boxes[i + 1] < boxes[j + 3] && boxes[j + 1] < boxes[i + 3]) {
+                    boxes[i] = std::min(boxes[i], boxes[j]);
+                    boxes[i + 1] = std::min(boxes[i + 1], boxes[j + 1]);
+                    boxes[i + 2] = std::max(boxes[i + 2], boxes[j + 2]);
+                    boxes[i + 3] = std::max(boxes[i + 3], boxes[j + 3]);
+                    boxes.erase(boxes.begin() + j, boxes.begin() + j + 4);
+                    merged = true;
+                }
+            }
+        }
+    }
+
+    regions.clear();
+    for(size_t i = 0; i < boxes.size(); i += 4) {
+        ImageType::IndexType index;
+        index[0] = imageRegion.GetIndex()[0] + boxes[i];
+        index[1] = imageRegion.GetIndex()[1] + boxes[i + 1];
+        ImageType::SizeType size;
+        size[0] = boxes[i + 2] - boxes[i];
+        size[1] = boxes[i + 3] - boxes[i + 1];
+        regions.push_back(ImageType::RegionType(index, size));
+    }
+    return changedPixels;
+}
+
+/* Segment and classify a region of the frame. The coins of 'coins' lying in the part of the
+   region that can be scanned exactly (away from cuts inside the frame by twice the closing
+   radius, like the pyramid scan) are replaced by the coins found there. */
+static void scanRegion(ImageType::Pointer image, ImageColorType::Pointer imageColor, const ImageType::RegionType& roi, const ScanOptions& options, std::vector<CoinResult>& coins) {
+    ImageType::RegionType imageRegion = image->GetBufferedRegion();
+    ImageType::Pointer input = image;
+    RegionOfInterestImageFilterType::Pointer roiFilter;
+    if(!(roi == imageRegion)) {
+        roiFilter = RegionOfInterestImageFilterType::New();
+        roiFilter->SetInput(image);
+        roiFilter->SetRegionOfInterest(roi);
+        roiFilter->Update();
+        input = roiFilter->GetOutput();
+    }
+    InvertIntensityImageFilterType::Pointer invertIntensityFilter = segmentImage(input, CLOSING_RADIUS, options);
+    std::vector<RegionStats> regions;
+    getRegionStats(invertIntensityFilter->GetOutput(), imageColor, roi.GetIndex(), regions);
+
+    long validStart[2];
+    long validEnd[2];
+    for(unsigned int d = 0; d < 2; d++) {
+        long start = roi.GetIndex()[d];
+        long end = start + roi.GetSize()[d];
+        long imageStart = imageRegion.GetIndex()[d];
+        long imageEnd = imageStart + imageRegion.GetSize()[d];
+        validStart[d] = start == imageStart ? start : start + 2 * CLOSING_RADIUS;
+        validEnd[d] = end == imageEnd ? end : end - 2 * CLOSING_RADIUS;
+    }
+
+    std::vector<CoinResult> kept;
+    for(size_t i = 0; i < coins.size(); i++) {
+        const CoinResult& coin = coins[i];
+        if(!(coin.x >= validStart[0] && coin.y >= validStart[1] && coin.x + coin.width <= validEnd[0] && coin.y + coin.height <= validEnd[1])) {
+            kept.push_back(coin);
+        }
+    }
+    coins.swap(kept);
+
+    for(size_t i = 0; i < regions.size(); i++) {
+        RegionStats& region = regions[i];
+        region.x += roi.GetIndex()[0];
+        region.y += roi.GetIndex()[1];
+        if(region.x >= validStart[0] && region.y >= validStart[1] && region.x + region.width <= validEnd[0] && region.y + region.height <= validEnd[1]) {
+            classifyRegion(region, 0, coins);
+        }
+    }
+}
+
+/* True if two coins of consecutive frames are the same coin */
+static bool sameCoin(const CoinResult& a, const CoinResult& b) {
+    return !strcmp(a.type, b.type) && abs((int) a.x - (int) b.x) <= VIDEO_MATCH_DISTANCE && abs((int) a.y - (int) b.y) <= VIDEO_MATCH_DISTANCE &&
+        abs((int) a.width - (int) b.width) <= VIDEO_MATCH_DISTANCE && abs((int) a.height - (int) b.height) <= VIDEO_MATCH_DISTANCE;
+}
+
+/* Write a list of coins of a frame record */
+static void writeCoins(const char* key, const std::vector<CoinResult>& coins) {
+    printf(", \"%s\": [", key);
+    for(size_t i = 0; i < coins.size(); i++) {
+        printf("%s{\"object\": %u, \"type\": \"%s\", \"x\": %u, \"y\": %u, \"length\": %ld}",
+            i > 0 ? ", " : "", coins[i].object, jsonEscape(coins[i].type).c_str(), coins[i].x, coins[i].y, coins[i].length);
+    }
+    printf("]");
+}
+
+int runVideo(const char* source, const ScanOptions& options, const VideoOptions& video) {
+    FrameSource frames;
+    if(!openFrameSource(source, video, frames)) {
+        fprintf(stderr, "Could not read video source: %s\n", source);
+        return 1;
+    }
+    showProgress = 0;
+
+    // Changes reach 2 * radius through the closing, and a coin touching them up to its length
+    // further, which must still be 2 * radius away from the region cuts
+    long margin = coinCatalog.GetMaxLength() + 4 * CLOSING_RADIUS;
+
+    ImageType::Pointer reference;
+    std::vector<CoinResult> coins;
+    unsigned int frame = 0;
+    unsigned int lastFull = 0;
+    unsigned int fullScans = 0;
+    unsigned int failed = 0;
+    unsigned int nextObject = 0;
+    double changedFraction = 0;
+    itk::TimeProbe totalTime;
+    totalTime.Start();
+    while(true) {
+        std::string name;
+        ImageColorType::Pointer imageColor;
+        try {
+            imageColor = readFrame(frames, name);
+        } catch(itk::ExceptionObject& e) {
+            printf("{\"frame\": %u, \"file\": \"%s\", \"status\": \"error\", \"error\": \"%s\"}\n", frame++, jsonEscape(name).c_str(), jsonEscape(e.GetDescription()).c_str());
+            failed++;
+            continue;
+        }
+        if(imageColor.IsNull()) {
+            break;
+        }
+
+        itk::TimeProbe time;
+        time.Start();
+        imageRecordBegin(name.c_str());
+        ImageType::Pointer image = convertToGray(imageColor);
+        ImageType::RegionType imageRegion = image->GetBufferedRegion();
+
+        // Full scan on the first frame, on a size change and every 'refresh' frames
+        std::vector<CoinResult> current;
+        std::vector<ImageType::RegionType> regions;
+        bool full = reference.IsNull() || !(reference->GetBufferedRegion() == imageRegion) || (video.refresh > 0 && frame - lastFull >= video.refresh);
+        if(full) {
+            regions.push_back(imageRegion);
+            reference = image;
+            lastFull = frame;
+            fullScans++;
+            changedFraction += 1;
+        } else {
+            StageProbe stage("difference", NULL);
+            unsigned long changedPixels = findChangedRegions(reference, image, margin, regions);
+            stage.Done(imageRegion.GetNumberOfPixels());
+            changedFraction += (double) changedPixels / imageRegion.GetNumberOfPixels();
+            current = coins;
+        }
+        for(size_t i = 0; i < regions.size(); i++) {
+            scanRegion(image, imageColor, regions[i], options, current);
+        }
+
+        // Coins found again keep their number, the others are added or removed
+        std::vector<CoinResult> added;
+        std::vector<CoinResult> removed;
+        std::vector<bool> matched(coins.size(), false);
+        for(size_t i = 0; i < current.size(); i++) {
+            size_t j = 0;
+            while(j < coins.size() && (matched[j] || !sameCoin(coins[j], current[i]))) {
+                j++;
+            }
+            if(j < coins.size()) {
+                matched[j] = true;
+                current[i].object = coins[j].object;
+            } else {
+                current[i].object = ++nextObject;
+                added.push_back(current[i]);
+            }
+        }
+        for(size_t j = 0; j < coins.size(); j++) {
+            if(!matched[j]) {
+                removed.push_back(coins[j]);
+            }
+        }
+        coins.swap(current);
+        imageRecordEnd();
+        time.Stop();
+
+        printf("{\"frame\": %u, \"file\": \"%s\", \"status\": \"ok\", \"scan\": \"%s\", \"regions\": %lu, \"seconds\": %.4f, \"coins\": %lu",
+            frame, jsonEscape(name).c_str(), full ? "full" : "partial", (unsigned long) regions.size(), time.GetTotal(), (unsigned long) coins.size());
+        writeCoins("added", added);
+        writeCoins("removed", removed);
+        printf("}\n");
+        fflush(stdout);
+        frame++;
+    }
+    totalTime.Stop();
+    if(frames.stream != NULL) {
+        fclose(frames.stream);
+    }
+
+    fprintf(stderr, "> Video: %u frames - %u full scans - %.1f%% changed on average - %.3fs - %.2f frames/s\n",
+        frame, fullScans, frame > 0 ? 100 * changedFraction / frame : 0.0, totalTime.GetTotal(),
+        totalTime.GetTotal() > 0 ? frame / totalTime.GetTotal() : 0.0);
+
+    return failed > 0 ? 1 : 0;
+}